@@ -0,0 +1,86 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_DETAIL_ARENA_H)
+#define _guard_JOBXX_DETAIL_ARENA_H
+#pragma once
+
+#include "jobxx/spinlock.h"
+#include "cache_line.h"
+#include "queue_impl.h"
+#include <cstddef>
+
+namespace jobxx
+{
+    namespace _detail
+    {
+
+        // linear scratch allocator for the tasks of one job. each worker
+        // bumps through chunks of its own, so allocation never contends;
+        // nothing is freed individually, and the whole arena is released
+        // at once when the job's last task completes.
+        struct arena
+        {
+            static constexpr std::size_t chunk_size = 16 * 1024;
+
+            arena() = default;
+            ~arena();
+
+            arena(arena const&) = delete;
+            arena& operator=(arena const&) = delete;
+
+            // worker is the index of the calling worker, or -1 for
+            // threads which are not workers of the job's queue.
+            void* allocate(int worker, std::size_t size, std::size_t alignment);
+
+        private:
+            struct chunk
+            {
+                chunk* next = nullptr;
+            };
+
+            struct alignas(cache_line_size) cursor
+            {
+                chunk* chunks = nullptr;
+                char* next = nullptr;
+                char* end = nullptr;
+            };
+
+            static void* _allocate(cursor& from, std::size_t size, std::size_t alignment);
+
+            cursor _workers[queue_impl::max_workers];
+            cursor _shared;
+            spinlock _shared_lock;
+        };
+
+    }
+}
+
+#endif // defined(_guard_JOBXX_DETAIL_ARENA_H)
@@ -33,18 +33,56 @@
 #pragma once
 
 #include "jobxx/park.h"
+#include "cache_line.h"
+#include "task.h"
 #include <atomic>
+#include <cstdint>
 
 namespace jobxx
 {
     namespace _detail
     {
 
+        struct arena;
+        struct job_account;
+
+        // every spawn and completion touches tasks, so it gets a cache
+        // line of its own rather than dragging the rarely-written refs
+        // along with it; the park's stack head gets another, as waiters
+        // push onto it while tasks are still retiring. the completion
+        // that takes tasks to zero (acq_rel, so it sees everything the
+        // job's tasks did) then releases the job in order: it frees the
+        // scratch arena, pops and wakes every parked waiter, spawns the
+        // continuations, and only then drops the tasks' reference.
         struct job_impl
         {
-            std::atomic<int> refs = 1;
-            std::atomic<int> tasks = 0;
-            park waiting;
+            job_impl() = default;
+            ~job_impl();
+
+            job_impl(job_impl const&) = delete;
+            job_impl& operator=(job_impl const&) = delete;
+
+            alignas(cache_line_size) std::atomic<int> refs = 1;
+            std::atomic<bool> cancelled = false;
+
+            // created on first use by context::allocate
+            std::atomic<arena*> scratch = nullptr;
+
+            // tasks to spawn once the job completes, after which this
+            // is set to completed() for good. a job completes only once,
+            // as queue::create_job holds it open until it is submitted.
+            std::atomic<task*> continuations = nullptr;
+            static task* completed() { static task marker; return &marker; }
+
+            // the totals a named job adds to, and its own figures;
+            // unnamed jobs aren't accounted at all.
+            job_account* account = nullptr;
+            std::atomic<std::uint64_t> accounted_tasks = 0;
+            std::atomic<std::uint64_t> cpu_ns = 0;
+            std::atomic<std::uint64_t> max_task_ns = 0;
+
+            alignas(cache_line_size) std::atomic<int> tasks = 0;
+            alignas(cache_line_size) park waiting;
         };
 
     }    
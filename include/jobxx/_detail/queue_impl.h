@@ -35,7 +35,15 @@
 #include "jobxx/delegate.h"
 #include "jobxx/concurrent_queue.h"
 #include "jobxx/park.h"
+#include "cache_line.h"
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 namespace jobxx
 {
@@ -47,16 +55,276 @@ namespace jobxx
 
         struct job_impl;
         struct task;
+        struct queue_impl;
+
+        // the halves of a worker's joins that other workers may steal.
+        // only the owning worker pushes and pops, at the bottom, while
+        // thieves take from the top; this is a Chase-Lev deque, but of
+        // fixed size, as joins nest no deeper than the worker's stack.
+        struct join_deque
+        {
+            static constexpr int capacity = 64;
+
+            // false if the deque is full. empty is set if it was empty
+            // until now, so that no worker has yet been woken for it.
+            bool push(_detail::task* item, bool& empty);
+            // nullptr if the most recent item was stolen.
+            _detail::task* pop();
+            _detail::task* steal();
+
+            alignas(cache_line_size) std::atomic<std::int64_t> top = 0;
+            alignas(cache_line_size) std::atomic<std::int64_t> bottom = 0;
+            std::atomic<_detail::task*> slots[capacity] = {};
+        };
+
+        // the most tasks a worker takes from the shared queue at once.
+        constexpr int max_task_batch = 16;
+
+        // tasks a worker took from the shared queue in one visit, to be
+        // run in order before it visits again. the owner and thieves alike
+        // take from the front, claiming a task by advancing the state; the
+        // owner only refills the batch once it is empty, and bumps the
+        // generation as it does, so that a thief can't claim a task it
+        // read before the refill.
+        struct task_batch
+        {
+            // only from the owning worker, and only while the batch is empty.
+            void fill(_detail::task* const* items, int count);
+            // nullptr if the batch is empty.
+            _detail::task* take();
+            // claims every task left, returning how many were copied to items.
+            int take_all(_detail::task** items);
+
+            bool empty() const;
+            // the task take() would return, for prefetching only; it may
+            // be claimed by someone else at any moment.
+            _detail::task* front() const;
+
+            // the generation, then the next and end positions
+            std::atomic<std::uint64_t> state = 0;
+            std::atomic<_detail::task*> slots[max_task_batch] = {};
+        };
+
+        // totals for every job of one name.
+        struct job_account
+        {
+            std::atomic<std::uint64_t> jobs = 0;
+            std::atomic<std::uint64_t> tasks = 0;
+            std::atomic<std::uint64_t> cpu_ns = 0;
+            std::atomic<std::uint64_t> max_task_ns = 0;
+        };
+
+        // tasks targeted at one particular worker of a queue.
+        struct mailbox
+        {
+            // whether a worker has the mailbox, so that it may be sent
+            // tasks; the main thread always has its own.
+            std::atomic<bool> open = false;
+
+            // lets the owning worker skip the lock when its mailbox is empty,
+            // which it almost always is.
+            std::atomic<int> pending = 0;
+            concurrent_queue<_detail::task*> tasks;
+            park waiting;
+
+            // the task most recently spawned by the owning worker, which
+            // it will run next while its inputs are still in cache. other
+            // workers take it if they run out of work first, so that it
+            // isn't stranded should the owner block.
+            std::atomic<_detail::task*> next_task = nullptr;
+
+            // the owning worker's batch, which other workers steal from
+            // once they run out of work.
+            task_batch batch;
+
+            join_deque joins;
+        };
+
+        // something other than the queue's park that idle workers may
+        // sleep in, such as an I/O reactor.
+        struct poller
+        {
+            virtual ~poller() = default;
+
+            // called by an idle worker. unless ready() is true once the
+            // worker is committed to sleeping, blocks until there are
+            // events to dispatch or wake() is called. returns false
+            // immediately if another worker is already polling.
+            virtual bool poll(predicate ready) = 0;
+
+            // called when work arrives that no parked worker was woken for.
+            virtual void wake() = 0;
+        };
+
+        // state of a thread while it works on a queue; only ever
+        // touched by that thread.
+        struct worker_state
+        {
+            queue_impl* queue = nullptr;
+
+            // the worker's identity and its mailbox, if it has one;
+            // threads that merely help out with work_one and friends
+            // do not.
+            int index = -1;
+            mailbox* inbox = nullptr;
+
+            // how many tasks in a row this thread has taken from its
+            // mailbox's LIFO slot; threads without a mailbox have none.
+            int lifo_streak = 0;
+
+            // how many spawned tasks this thread is running inline,
+            // one within another.
+            int inline_depth = 0;
+
+            // how many tasks this thread is in the middle of running, one
+            // within another, e.g. while one waits on a job.
+            int task_depth = 0;
+
+            // how many tasks to take from the shared queue into the
+            // mailbox's batch next time. it grows while the queue keeps
+            // the batch full, and shrinks when it doesn't; threads without
+            // a mailbox take one task at a time.
+            int batch_size = 1;
+
+            // completions of tasks of the job this thread is working on,
+            // not yet subtracted from the job's shared task count, and
+            // what they cost if the job is accounted.
+            _detail::job_impl* retired_job = nullptr;
+            int retired_tasks = 0;
+            int accounted_tasks = 0;
+            std::uint64_t cpu_ns = 0;
+            std::uint64_t max_task_ns = 0;
+        };
 
         struct queue_impl
         {
-            spawn_result spawn_task(delegate work, _detail::job_impl* parent);
+            // how many tasks in a row a thread may take from its LIFO slot
+            // before it must yield to the older tasks in the shared queue.
+            static constexpr int max_lifo_streak = 8;
+
+            // how deeply spawned tasks may be run inline, one within
+            // another, before they're queued regardless, so that a chain
+            // of tasks each spawning the next can't exhaust the stack.
+            static constexpr int max_inline_depth = 16;
+
+            // upper bound on worker ids; worker 0 is the thread that
+            // created the queue.
+            static constexpr int max_workers = 64;
+
+            queue_impl() : owner(std::this_thread::get_id()), mailboxes(new mailbox[max_workers])
+            {
+                mailboxes[0].open.store(true, std::memory_order_relaxed);
+            }
+
+            // work is only consumed if the task is actually spawned.
+            spawn_result spawn_task(delegate&& work, _detail::job_impl* parent);
+            spawn_result spawn_task_blocking(delegate&& work, _detail::job_impl* parent);
+            spawn_result spawn_task_on(int worker, delegate&& work, _detail::job_impl* parent);
+            // hands the tasks of a mailbox no worker has to the shared queue.
+            void drain_mailbox(mailbox& inbox);
+
+            // takes the lowest free worker id for a thread entering
+            // work_forever, or -1 if all are taken, and gives it back
+            // once the thread has left and its mailbox is drained.
+            int acquire_worker();
+            void release_worker(int index);
+            spawn_result spawn_urgent_task(delegate&& work, _detail::job_impl* parent);
+            // spawns a task the caller allocated (which may not be owned).
+            spawn_result spawn_node(_detail::task* item);
+            // hands a spawned task to the calling worker or the other workers.
+            void schedule(_detail::task* item);
             _detail::task* pull_task();
+            _detail::task* pull_urgent();
+            void push_task(_detail::task* item);
+            // hands the worker's unrun batch back to the shared queue.
+            void return_batch(worker_state& worker);
+            // hands back its batch and its LIFO slot both, and lets go of
+            // any completions it is holding back, for when it is about to
+            // leave or block.
+            void release_held_tasks(worker_state& worker);
+
+            // see join.h. push_join fails if the calling thread has no
+            // deque of its own, or it is full.
+            bool push_join(_detail::task* item);
+            bool pop_join(_detail::task* item);
+
+            // takes work another worker has set aside for itself: the
+            // halves of its joins, its LIFO slot, or its batch. stealable tells
+            // whether there is any, without taking it.
+            _detail::task* steal_task();
+            bool stealable() const;
+
+            // runs tasks until ready() holds, sleeping on target when idle.
+            void wait_until(park& target, predicate ready);
+            void wake_poller();
             void execute(_detail::task* item);
 
+            // job task counting; see execute() for why retirement is deferred.
+            void add_task(_detail::job_impl* parent);
+            void retire_tasks(_detail::job_impl* parent, int count);
+            void flush_retired(worker_state& worker);
+
+            // per-name totals of named jobs. entries are never removed,
+            // so jobs may keep pointers to them.
+            job_account* find_account(char const* name);
+            std::mutex accounts_lock;
+            std::map<std::string, job_account> accounts;
+
+            // the calling thread's state if it is working on this queue.
+            worker_state* local_worker() const;
+
+            // whether a task spawned now should be run inline, see
+            // queue_capacity::inline_threshold.
+            bool should_inline(worker_state const* worker) const;
+
+            // force takes the slot even if the queue is full
+            bool reserve_slot(bool force = false);
+            void release_slot();
+            bool counts_tasks() const { return max_tasks != 0 || high_watermark != 0 || inline_threshold != 0; }
+
             concurrent_queue<_detail::task*> tasks;
             park waiting;
             std::atomic<bool> closed = false;
+
+            // capacity bookkeeping; unused unless counts_tasks().
+            std::size_t max_tasks = 0;
+            std::size_t high_watermark = 0;
+            std::size_t low_watermark = 0;
+            std::size_t inline_threshold = 0;
+            void(*on_watermark)(void*, bool) = nullptr;
+            void* watermark_data = nullptr;
+            std::atomic<std::size_t> queued = 0;
+            std::atomic<bool> above_watermark = false;
+            park not_full;
+
+            // targeted tasks bypass the shared queue (and its capacity)
+            // entirely, and only wake the worker they're targeted at.
+            std::thread::id const owner;
+            // ids in use, worker 0's always, and one more than the highest
+            // ever handed out, which bounds the mailboxes worth stealing from.
+            std::atomic<std::uint64_t> used_workers = 1;
+            std::atomic<int> next_worker = 1;
+
+            // the urgent lane, which like a mailbox bypasses the capacity
+            // and is only locked when it has something in it. urgent
+            // workers sleep on their own park, so that bulk tasks never
+            // wake them.
+            std::atomic<int> urgent_pending = 0;
+            concurrent_queue<_detail::task*> urgent_tasks;
+            park urgent_waiting;
+
+            // workers in work_forever (or retiring spares) with nothing
+            // to do, whether parked or polling.
+            std::atomic<int> idle_workers = 0;
+            std::unique_ptr<mailbox[]> const mailboxes;
+
+            // the poller is pinned while in use, so that whoever installed
+            // it can wait for it to be unused before destroying it.
+            poller* acquire_poller();
+            void release_poller();
+
+            std::atomic<poller*> io_poller = nullptr;
+            std::atomic<int> poller_users = 0;
         };
 
     }
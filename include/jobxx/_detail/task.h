@@ -46,6 +46,14 @@ namespace jobxx
         {
             delegate work;
             _detail::job_impl* parent = nullptr;
+
+            // false for tasks embedded in storage of the spawner's, such as
+            // a sender's operation state; the queue must then neither
+            // delete the task nor touch it once its work has begun.
+            bool owned = true;
+
+            // links tasks waiting for a job to complete
+            task* next = nullptr;
         };
 
     }    
@@ -0,0 +1,475 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_ALGORITHM_H)
+#define _guard_JOBXX_ALGORITHM_H
+#pragma once
+
+#include "context.h"
+#include "job.h"
+#include "queue.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// parallel versions of standard algorithms, running on a queue. each
+// one runs as a job that the calling thread takes part in (waiting for
+// it actively), so they may be used from inside tasks too. inputs no
+// bigger than a single base case run serially, without a job at all.
+// iterators must be random access.
+
+namespace jobxx
+{
+
+    namespace _detail
+    {
+
+        // FIXME: these are typical of current desktop parts; the base
+        // cases only need to be the right order of magnitude.
+        constexpr std::size_t l1_cache_size = 32 * 1024;
+        constexpr std::size_t l2_cache_size = 256 * 1024;
+
+        template <typename ValueT>
+        constexpr std::size_t elements_in(std::size_t bytes)
+        {
+            return bytes / sizeof(ValueT) > 0 ? bytes / sizeof(ValueT) : 1;
+        }
+
+        // elementwise passes work on blocks of a quarter of the L2, so
+        // that a block's input and output both stay in cache with room
+        // to spare; sorting works on runs that fit in the L2 alongside
+        // their merge buffer.
+        template <typename ValueT> constexpr std::size_t block_size() { return elements_in<ValueT>(l2_cache_size / 4); }
+        template <typename ValueT> constexpr std::size_t sort_run_size() { return elements_in<ValueT>(l2_cache_size / 2); }
+
+        // recursively halves [begin, end), spawning the upper halves as
+        // tasks, until the pieces are no bigger than grain.
+        template <typename BodyT>
+        struct range_splitter
+        {
+            BodyT* body = nullptr;
+            std::size_t grain = 1;
+
+            void run(context& ctx, std::size_t begin, std::size_t end)
+            {
+                while (end - begin > grain)
+                {
+                    std::size_t const middle = begin + (end - begin) / 2;
+                    if (ctx.spawn_task([this, middle, end](context& inner){ run(inner, middle, end); }) != spawn_result::success)
+                    {
+                        // a full or closed queue leaves the rest to us
+                        break;
+                    }
+                    end = middle;
+                }
+                (*body)(begin, end);
+            }
+        };
+
+        // invokes body(begin, end) over pieces of [0, count) in parallel.
+        template <typename BodyT>
+        void parallel_ranges(queue& queue, std::size_t count, std::size_t grain, BodyT&& body)
+        {
+            if (count <= grain)
+            {
+                if (count != 0)
+                {
+                    body(std::size_t(0), count);
+                }
+                return;
+            }
+
+            range_splitter<std::remove_reference_t<BodyT>> splitter{&body, grain};
+            job work = queue.create_job([&splitter, count](context& ctx){ splitter.run(ctx, 0, count); });
+            queue.wait_job_actively(work);
+        }
+
+        // invokes body(block, begin, end) for each block of block_size
+        // elements of [0, count), in parallel.
+        template <typename BodyT>
+        void parallel_blocks(queue& queue, std::size_t count, std::size_t block_size, BodyT&& body)
+        {
+            std::size_t const blocks = (count + block_size - 1) / block_size;
+            parallel_ranges(queue, blocks, 1, [&body, count, block_size](std::size_t first, std::size_t last)
+            {
+                for (std::size_t block = first; block != last; ++block)
+                {
+                    std::size_t const begin = block * block_size;
+                    body(block, begin, std::min(begin + block_size, count));
+                }
+            });
+        }
+
+        // storage for values that are constructed (and destroyed) by
+        // the algorithm using it, rather than default constructed.
+        template <typename ValueT>
+        class uninitialized_buffer
+        {
+        public:
+            explicit uninitialized_buffer(std::size_t size) : _data(static_cast<ValueT*>(::operator new(size * sizeof(ValueT)))) {}
+            ~uninitialized_buffer()
+            {
+                for (std::size_t index = 0; index != _constructed; ++index)
+                {
+                    _data[index].~ValueT();
+                }
+                ::operator delete(_data);
+            }
+
+            uninitialized_buffer(uninitialized_buffer const&) = delete;
+            uninitialized_buffer& operator=(uninitialized_buffer const&) = delete;
+
+            ValueT* data() const { return _data; }
+
+            // the first count values have been constructed.
+            void constructed(std::size_t count) { _constructed = count; }
+
+        private:
+            ValueT* _data = nullptr;
+            std::size_t _constructed = 0;
+        };
+
+        // the number of elements of a that the first k elements of the
+        // (stable) merge of a and b take, found by binary search.
+        template <typename IteratorT, typename CompareT>
+        std::size_t merge_rank(std::size_t k, IteratorT a, std::size_t a_size, IteratorT b, std::size_t b_size, CompareT& compare)
+        {
+            std::size_t low = k > b_size ? k - b_size : 0;
+            std::size_t high = std::min(k, a_size);
+            while (low < high)
+            {
+                std::size_t const middle = low + (high - low) / 2;
+                if (compare(b[k - middle - 1], a[middle]))
+                {
+                    high = middle;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+            return low;
+        }
+
+        // merges each pair of adjacent sorted runs of width elements from
+        // source into destination. every merge is cut into pieces of the
+        // output that are independent of one another, so that even the
+        // last, biggest merge is spread across the workers.
+        template <typename SourceT, typename DestinationT, typename CompareT>
+        void merge_runs(queue& queue, SourceT source, DestinationT destination, std::size_t count, std::size_t width, CompareT& compare)
+        {
+            using value_type = typename std::iterator_traits<SourceT>::value_type;
+
+            std::size_t const piece = block_size<value_type>();
+            std::size_t const pairs = (count + 2 * width - 1) / (2 * width);
+            std::size_t const pieces = (2 * width + piece - 1) / piece;
+
+            struct bounds
+            {
+                std::size_t a_begin, b_begin, b_end, out_begin, out_end;
+            };
+            auto const piece_bounds = [=](std::size_t index)
+            {
+                bounds result;
+                result.a_begin = (index / pieces) * 2 * width;
+                result.b_begin = std::min(result.a_begin + width, count);
+                result.b_end = std::min(result.b_begin + width, count);
+                std::size_t const total = result.b_end - result.a_begin;
+                result.out_begin = std::min((index % pieces) * piece, total);
+                result.out_end = std::min(result.out_begin + piece, total);
+                return result;
+            };
+
+            // every piece is located before any are merged, since merging
+            // moves from the very elements that the searches look at.
+            std::vector<std::size_t> splits(pairs * pieces);
+            parallel_ranges(queue, pairs * pieces, 1, [=, &splits, &compare](std::size_t first, std::size_t last)
+            {
+                for (std::size_t index = first; index != last; ++index)
+                {
+                    bounds const at = piece_bounds(index);
+                    splits[index] = merge_rank(at.out_begin, source + at.a_begin, at.b_begin - at.a_begin, source + at.b_begin, at.b_end - at.b_begin, compare);
+                }
+            });
+
+            parallel_ranges(queue, pairs * pieces, 1, [=, &splits, &compare](std::size_t first, std::size_t last)
+            {
+                for (std::size_t index = first; index != last; ++index)
+                {
+                    bounds const at = piece_bounds(index);
+                    if (at.out_begin == at.out_end)
+                    {
+                        continue;
+                    }
+
+                    // a piece that doesn't end its merge ends where the next begins
+                    SourceT const a = source + at.a_begin;
+                    SourceT const b = source + at.b_begin;
+                    std::size_t const a_first = splits[index];
+                    std::size_t const a_last = at.out_end == at.b_end - at.a_begin ? at.b_begin - at.a_begin : splits[index + 1];
+
+                    std::merge(
+                        std::make_move_iterator(a + a_first), std::make_move_iterator(a + a_last),
+                        std::make_move_iterator(b + (at.out_begin - a_first)), std::make_move_iterator(b + (at.out_end - a_last)),
+                        destination + at.a_begin + at.out_begin, compare);
+                }
+            });
+        }
+
+    }
+
+    // as std::transform.
+    template <typename InputIteratorT, typename OutputIteratorT, typename FunctionT>
+    OutputIteratorT parallel_transform(queue& queue, InputIteratorT first, InputIteratorT last, OutputIteratorT out, FunctionT func)
+    {
+        using value_type = typename std::iterator_traits<InputIteratorT>::value_type;
+
+        std::size_t const count = static_cast<std::size_t>(last - first);
+        _detail::parallel_ranges(queue, count, _detail::block_size<value_type>(), [first, out, &func](std::size_t begin, std::size_t end)
+        {
+            std::transform(first + begin, first + end, out + begin, func);
+        });
+        return out + count;
+    }
+
+    // as std::sort: a merge sort of runs sorted with std::sort. it needs
+    // a buffer as big as the input, and is not stable.
+    template <typename IteratorT, typename CompareT = std::less<>>
+    void parallel_sort(queue& queue, IteratorT first, IteratorT last, CompareT compare = CompareT())
+    {
+        using value_type = typename std::iterator_traits<IteratorT>::value_type;
+
+        std::size_t const count = static_cast<std::size_t>(last - first);
+        std::size_t const run = _detail::sort_run_size<value_type>();
+        if (count <= run)
+        {
+            std::sort(first, last, compare);
+            return;
+        }
+
+        _detail::parallel_blocks(queue, count, run, [first, &compare](std::size_t, std::size_t begin, std::size_t end)
+        {
+            std::sort(first + begin, first + end, compare);
+        });
+
+        _detail::uninitialized_buffer<value_type> buffer(count);
+        value_type* const scratch = buffer.data();
+        _detail::parallel_blocks(queue, count, _detail::block_size<value_type>(), [first, scratch](std::size_t, std::size_t begin, std::size_t end)
+        {
+            for (std::size_t index = begin; index != end; ++index)
+            {
+                new (scratch + index) value_type(std::move(first[index]));
+            }
+        });
+        buffer.constructed(count);
+
+        // the sorted runs are in the buffer now. ping-pong between it and
+        // the input, doubling the width of the runs each time.
+        bool in_buffer = true;
+        for (std::size_t width = run; width < count; width *= 2)
+        {
+            if (in_buffer)
+            {
+                _detail::merge_runs(queue, scratch, first, count, width, compare);
+            }
+            else
+            {
+                _detail::merge_runs(queue, first, scratch, count, width, compare);
+            }
+            in_buffer = !in_buffer;
+        }
+
+        if (in_buffer)
+        {
+            _detail::parallel_blocks(queue, count, _detail::block_size<value_type>(), [first, scratch](std::size_t, std::size_t begin, std::size_t end)
+            {
+                std::move(scratch + begin, scratch + end, first + begin);
+            });
+        }
+    }
+
+    // as std::copy_if.
+    template <typename InputIteratorT, typename OutputIteratorT, typename PredicateT>
+    OutputIteratorT parallel_copy_if(queue& queue, InputIteratorT first, InputIteratorT last, OutputIteratorT out, PredicateT pred)
+    {
+        using value_type = typename std::iterator_traits<InputIteratorT>::value_type;
+
+        std::size_t const count = static_cast<std::size_t>(last - first);
+        std::size_t const block = _detail::block_size<value_type>();
+        if (count <= block)
+        {
+            return std::copy_if(first, last, out, pred);
+        }
+
+        // count each block's selected elements, then copy each block to
+        // where the blocks before it end.
+        std::size_t const blocks = (count + block - 1) / block;
+        std::vector<unsigned char> selected(count);
+        std::vector<std::size_t> offsets(blocks + 1);
+        _detail::parallel_blocks(queue, count, block, [first, &pred, &selected, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            std::size_t total = 0;
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                selected[element] = pred(first[element]) ? 1 : 0;
+                total += selected[element];
+            }
+            offsets[index + 1] = total;
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        _detail::parallel_blocks(queue, count, block, [first, out, &selected, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            OutputIteratorT target = out + offsets[index];
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                if (selected[element] != 0)
+                {
+                    *target++ = first[element];
+                }
+            }
+        });
+        return out + offsets[blocks];
+    }
+
+    // as std::stable_partition (the parallel version is stable anyway,
+    // as it goes through a buffer as big as the input).
+    template <typename IteratorT, typename PredicateT>
+    IteratorT parallel_partition(queue& queue, IteratorT first, IteratorT last, PredicateT pred)
+    {
+        using value_type = typename std::iterator_traits<IteratorT>::value_type;
+
+        std::size_t const count = static_cast<std::size_t>(last - first);
+        std::size_t const block = _detail::block_size<value_type>();
+        if (count <= block)
+        {
+            return std::stable_partition(first, last, pred);
+        }
+
+        std::size_t const blocks = (count + block - 1) / block;
+        std::vector<unsigned char> selected(count);
+        std::vector<std::size_t> offsets(blocks + 1);
+        _detail::parallel_blocks(queue, count, block, [first, &pred, &selected, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            std::size_t total = 0;
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                selected[element] = pred(first[element]) ? 1 : 0;
+                total += selected[element];
+            }
+            offsets[index + 1] = total;
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::size_t const selected_count = offsets[blocks];
+
+        // the rejected elements of a block go after all the selected ones,
+        // behind the rejected elements of the blocks before it.
+        _detail::uninitialized_buffer<value_type> buffer(count);
+        value_type* const scratch = buffer.data();
+        _detail::parallel_blocks(queue, count, block, [first, scratch, selected_count, &selected, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            std::size_t accepted = offsets[index];
+            std::size_t rejected = selected_count + (begin - offsets[index]);
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                std::size_t& target = selected[element] != 0 ? accepted : rejected;
+                new (scratch + target++) value_type(std::move(first[element]));
+            }
+        });
+        buffer.constructed(count);
+
+        _detail::parallel_blocks(queue, count, block, [first, scratch](std::size_t, std::size_t begin, std::size_t end)
+        {
+            std::move(scratch + begin, scratch + end, first + begin);
+        });
+        return first + selected_count;
+    }
+
+    // as std::unique.
+    template <typename IteratorT, typename EqualT = std::equal_to<>>
+    IteratorT parallel_unique(queue& queue, IteratorT first, IteratorT last, EqualT equal = EqualT())
+    {
+        using value_type = typename std::iterator_traits<IteratorT>::value_type;
+
+        std::size_t const count = static_cast<std::size_t>(last - first);
+        std::size_t const block = _detail::block_size<value_type>();
+        if (count <= block)
+        {
+            return std::unique(first, last, equal);
+        }
+
+        // every comparison is made before anything is moved
+        std::size_t const blocks = (count + block - 1) / block;
+        std::vector<unsigned char> kept(count);
+        std::vector<std::size_t> offsets(blocks + 1);
+        _detail::parallel_blocks(queue, count, block, [first, &equal, &kept, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            std::size_t total = 0;
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                kept[element] = element == 0 || !equal(first[element - 1], first[element]) ? 1 : 0;
+                total += kept[element];
+            }
+            offsets[index + 1] = total;
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::size_t const kept_count = offsets[blocks];
+
+        _detail::uninitialized_buffer<value_type> buffer(kept_count);
+        value_type* const scratch = buffer.data();
+        _detail::parallel_blocks(queue, count, block, [first, scratch, &kept, &offsets](std::size_t index, std::size_t begin, std::size_t end)
+        {
+            std::size_t target = offsets[index];
+            for (std::size_t element = begin; element != end; ++element)
+            {
+                if (kept[element] != 0)
+                {
+                    new (scratch + target++) value_type(std::move(first[element]));
+                }
+            }
+        });
+        buffer.constructed(kept_count);
+
+        _detail::parallel_blocks(queue, kept_count, block, [first, scratch](std::size_t, std::size_t begin, std::size_t end)
+        {
+            std::move(scratch + begin, scratch + end, first + begin);
+        });
+        return first + kept_count;
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_ALGORITHM_H)
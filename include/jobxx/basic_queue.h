@@ -0,0 +1,430 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_BASIC_QUEUE_H)
+#define _guard_JOBXX_BASIC_QUEUE_H
+#pragma once
+
+#include "delegate.h"
+#include "park.h"
+#include "queue.h"
+#include "spinlock.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace jobxx
+{
+
+    namespace _detail
+    {
+
+        // the unit of work of a basic_queue: a function taking no
+        // arguments, under the same restrictions as a delegate.
+        struct basic_task
+        {
+            void(*thunk)(void*) = nullptr;
+            std::aligned_storage_t<delegate::max_size, delegate::max_alignment> storage;
+            basic_task* next = nullptr;
+        };
+
+    }
+
+    // -- queue policies: how tasks are handed from spawners to workers.
+    // each provides push (false if the task was refused), pop (nullptr
+    // if there is nothing to take) and maybe_empty.
+
+    // any number of threads may spawn and work.
+    class locked_queue_policy
+    {
+    public:
+        inline bool push(_detail::basic_task* item);
+        inline _detail::basic_task* pop();
+        inline bool maybe_empty() const;
+
+    private:
+        mutable spinlock _lock;
+        _detail::basic_task* _head = nullptr;
+        _detail::basic_task* _tail = nullptr;
+    };
+
+    // a fixed-size ring that only one thread may spawn into, without
+    // locking; any number of threads may work. spawns into a full ring
+    // are refused with spawn_result::queue_full.
+    template <std::size_t Capacity>
+    class spmc_ring_queue_policy
+    {
+    public:
+        static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "spmc_ring_queue_policy capacity must be a power of two");
+
+        inline bool push(_detail::basic_task* item);
+        inline _detail::basic_task* pop();
+        inline bool maybe_empty() const;
+
+    private:
+        std::atomic<std::size_t> _head = 0;
+        std::atomic<std::size_t> _tail = 0;
+        std::atomic<_detail::basic_task*> _slots[Capacity] = {};
+    };
+
+    // -- allocation policies: where tasks live. each provides allocate
+    // and deallocate; tasks are allocated by spawners and deallocated
+    // by whichever worker ran them.
+
+    class heap_alloc_policy
+    {
+    public:
+        _detail::basic_task* allocate() { return new _detail::basic_task; }
+        void deallocate(_detail::basic_task* item) { delete item; }
+    };
+
+    // recycles tasks through a free list, so that a queue in its steady
+    // state doesn't allocate at all.
+    class pooled_alloc_policy
+    {
+    public:
+        pooled_alloc_policy() = default;
+        inline ~pooled_alloc_policy();
+
+        pooled_alloc_policy(pooled_alloc_policy const&) = delete;
+        pooled_alloc_policy& operator=(pooled_alloc_policy const&) = delete;
+
+        inline _detail::basic_task* allocate();
+        inline void deallocate(_detail::basic_task* item);
+
+    private:
+        spinlock _lock;
+        _detail::basic_task* _free = nullptr;
+    };
+
+    // -- wake policies: what idle workers do. each provides notify_one,
+    // notify_all and wait(predicate), which returns once it has slept or
+    // the predicate has become true.
+
+    // idle workers park, and each spawn unparks one of them.
+    class park_wake_policy
+    {
+    public:
+        void notify_one() { _waiting.unpark_one(); }
+        void notify_all() { _waiting.unpark_all(); }
+        void wait(predicate ready) { _waiting.park_until(ready); }
+
+    private:
+        park _waiting;
+    };
+
+    // idle workers keep polling, so spawning never has to wake anyone.
+    class no_wake_policy
+    {
+    public:
+        void notify_one() {}
+        void notify_all() {}
+        void wait(predicate ready) { if (!ready()) std::this_thread::yield(); }
+    };
+
+    // a standalone, lightweight task queue whose structure, task
+    // allocation and wake strategy are chosen at compile time, so that
+    // the spawn and work paths can be inlined in full.
+    //
+    // it is not the library's queue: jobxx::queue is not built on these
+    // policies, nor is it one of their specializations, and the two
+    // share no tasks or workers. basic_queue only runs plain tasks;
+    // jobs, contexts, mailboxes, LIFO slots, capacity limits and the
+    // other services of jobxx::queue need its shared implementation,
+    // and so stay there. it suits code that needs none of those and
+    // can't afford their cost.
+    template <typename QueuePolicy = locked_queue_policy, typename AllocPolicy = heap_alloc_policy, typename WakePolicy = park_wake_policy>
+    class basic_queue
+    {
+    public:
+        using queue_policy = QueuePolicy;
+        using alloc_policy = AllocPolicy;
+        using wake_policy = WakePolicy;
+
+        basic_queue() = default;
+        inline ~basic_queue();
+
+        basic_queue(basic_queue const&) = delete;
+        basic_queue& operator=(basic_queue const&) = delete;
+
+        template <typename FunctionT> spawn_result spawn_task(FunctionT&& func);
+
+        inline bool work_one();
+        inline void work_all();
+        inline void work_forever();
+
+        inline void close();
+
+    private:
+        inline void _execute(_detail::basic_task* item);
+
+        queue_policy _tasks;
+        alloc_policy _alloc;
+        wake_policy _wake;
+        std::atomic<bool> _closed = false;
+    };
+
+    bool locked_queue_policy::push(_detail::basic_task* item)
+    {
+        std::lock_guard<spinlock> _(_lock);
+
+        item->next = nullptr;
+        if (_tail != nullptr)
+        {
+            _tail->next = item;
+        }
+        else
+        {
+            _head = item;
+        }
+        _tail = item;
+        return true;
+    }
+
+    _detail::basic_task* locked_queue_policy::pop()
+    {
+        std::lock_guard<spinlock> _(_lock);
+
+        _detail::basic_task* const item = _head;
+        if (item != nullptr)
+        {
+            _head = item->next;
+            if (_head == nullptr)
+            {
+                _tail = nullptr;
+            }
+        }
+        return item;
+    }
+
+    bool locked_queue_policy::maybe_empty() const
+    {
+        std::lock_guard<spinlock> _(_lock);
+        return _head == nullptr;
+    }
+
+    template <std::size_t Capacity>
+    bool spmc_ring_queue_policy<Capacity>::push(_detail::basic_task* item)
+    {
+        // only we move the tail, so it needs no synchronization with
+        // ourselves; the head tells us which slots have been emptied.
+        std::size_t const tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) >= Capacity)
+        {
+            return false;
+        }
+
+        _slots[tail & (Capacity - 1)].store(item, std::memory_order_relaxed);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <std::size_t Capacity>
+    _detail::basic_task* spmc_ring_queue_policy<Capacity>::pop()
+    {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (head == _tail.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+
+            // the slot can't be reused until the head has moved past
+            // it, so what we read is only ours if we move the head.
+            _detail::basic_task* const item = _slots[head & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                return item;
+            }
+        }
+    }
+
+    template <std::size_t Capacity>
+    bool spmc_ring_queue_policy<Capacity>::maybe_empty() const
+    {
+        return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+    }
+
+    pooled_alloc_policy::~pooled_alloc_policy()
+    {
+        while (_free != nullptr)
+        {
+            _detail::basic_task* const item = _free;
+            _free = item->next;
+            delete item;
+        }
+    }
+
+    _detail::basic_task* pooled_alloc_policy::allocate()
+    {
+        {
+            std::lock_guard<spinlock> _(_lock);
+            if (_free != nullptr)
+            {
+                _detail::basic_task* const item = _free;
+                _free = item->next;
+                return item;
+            }
+        }
+        return new _detail::basic_task;
+    }
+
+    void pooled_alloc_policy::deallocate(_detail::basic_task* item)
+    {
+        std::lock_guard<spinlock> _(_lock);
+        item->next = _free;
+        _free = item;
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::~basic_queue()
+    {
+        // as with jobxx::queue, closing runs whatever is still queued
+        close();
+
+        // a spawn racing with the close may still have slipped in after
+        // the last run; there's no one left to run it now.
+        while (_detail::basic_task* const item = _tasks.pop())
+        {
+            _alloc.deallocate(item);
+        }
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    template <typename FunctionT>
+    spawn_result basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::spawn_task(FunctionT&& func)
+    {
+        using func_type = std::remove_reference_t<FunctionT>;
+
+        static_assert(sizeof(func_type) <= delegate::max_size, "function too large for jobxx::basic_queue");
+        static_assert(alignof(func_type) <= delegate::max_alignment, "function over-aligned for jobxx::basic_queue");
+        static_assert(std::is_trivially_move_constructible_v<func_type>, "function not a trivially move-constructible as required by jobxx::basic_queue");
+        static_assert(std::is_trivially_destructible_v<func_type>, "function not a trivially destructible as required by jobxx::basic_queue");
+
+        if (_closed.load(std::memory_order_acquire))
+        {
+            return spawn_result::queue_closed;
+        }
+
+        _detail::basic_task* const item = _alloc.allocate();
+        item->thunk = [](void* storage){ (*static_cast<func_type*>(storage))(); };
+        new (&item->storage) func_type(std::forward<FunctionT>(func));
+
+        if (!_tasks.push(item))
+        {
+            _alloc.deallocate(item);
+            return spawn_result::queue_full;
+        }
+
+        _wake.notify_one();
+        return spawn_result::success;
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    void basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::_execute(_detail::basic_task* item)
+    {
+        item->thunk(&item->storage);
+        _alloc.deallocate(item);
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    bool basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::work_one()
+    {
+        _detail::basic_task* const item = _tasks.pop();
+        if (item != nullptr)
+        {
+            _execute(item);
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    void basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::work_all()
+    {
+        while (work_one())
+        {
+            // keep looping while there's work
+        }
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    void basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::work_forever()
+    {
+        while (!_closed.load(std::memory_order_relaxed))
+        {
+            _detail::basic_task* item = nullptr;
+            auto task_available = [this, &item]
+            {
+                return _closed.load(std::memory_order_relaxed) || (item = _tasks.pop()) != nullptr;
+            };
+
+            if (!task_available())
+            {
+                _wake.wait(task_available);
+            }
+
+            // as with jobxx::queue, a wakeup obliges us to look for the
+            // task that caused it even if the predicate didn't find it.
+            if (item == nullptr)
+            {
+                item = _tasks.pop();
+            }
+            if (item != nullptr)
+            {
+                _execute(item);
+            }
+        }
+
+        work_all();
+    }
+
+    template <typename QueuePolicy, typename AllocPolicy, typename WakePolicy>
+    void basic_queue<QueuePolicy, AllocPolicy, WakePolicy>::close()
+    {
+        work_all();
+
+        _closed.store(true, std::memory_order_release);
+        _wake.notify_all();
+
+        work_all();
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_BASIC_QUEUE_H)
@@ -0,0 +1,218 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_CHANNEL_H)
+#define _guard_JOBXX_CHANNEL_H
+#pragma once
+
+#include "park.h"
+#include "queue.h"
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace jobxx
+{
+
+    enum class channel_result
+    {
+        success,
+        full,
+        empty,
+        closed
+    };
+
+    // a multi-producer multi-consumer channel of values. a waiting
+    // sender or receiver is parked, and is unparked directly by the
+    // receive or send that lets it proceed. the overloads taking a
+    // queue run that queue's tasks while they wait instead.
+    template <typename Value>
+    class channel
+    {
+    public:
+        using value_type = Value;
+
+        // a capacity of 0 means unbounded; sends then never wait.
+        explicit channel(std::size_t capacity = 0) : _capacity(capacity) {}
+
+        channel(channel const&) = delete;
+        channel& operator=(channel const&) = delete;
+
+        // the value is only moved from if the send succeeds.
+        template <typename InsertValue> channel_result try_send(InsertValue&& value);
+        template <typename InsertValue> channel_result send(InsertValue&& value);
+        template <typename InsertValue> channel_result send(queue& helper, InsertValue&& value);
+
+        // a closed channel still yields its remaining values, and only
+        // reports channel_result::closed once it has been drained.
+        inline channel_result try_recv(value_type& out);
+        inline channel_result recv(value_type& out);
+        inline channel_result recv(queue& helper, value_type& out);
+
+        // fails any further sends, and wakes everyone waiting.
+        inline void close();
+        inline bool closed() const;
+
+    private:
+        mutable std::mutex _lock;
+        std::deque<value_type> _values;
+        std::size_t const _capacity = 0;
+        bool _closed = false;
+
+        park _readable;
+        park _writable;
+    };
+
+    template <typename Value>
+    template <typename InsertValue>
+    channel_result channel<Value>::try_send(InsertValue&& value)
+    {
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            if (_closed)
+            {
+                return channel_result::closed;
+            }
+            if (_capacity != 0 && _values.size() >= _capacity)
+            {
+                return channel_result::full;
+            }
+            _values.push_back(std::forward<InsertValue>(value));
+        }
+
+        _readable.unpark_one();
+        return channel_result::success;
+    }
+
+    template <typename Value>
+    template <typename InsertValue>
+    channel_result channel<Value>::send(InsertValue&& value)
+    {
+        // the predicate must not send twice once it has succeeded
+        channel_result result = channel_result::full;
+        auto sent = [this, &value, &result]
+        {
+            return result != channel_result::full || (result = try_send(std::forward<InsertValue>(value))) != channel_result::full;
+        };
+
+        while (!sent())
+        {
+            _writable.park_until(sent);
+        }
+        return result;
+    }
+
+    template <typename Value>
+    template <typename InsertValue>
+    channel_result channel<Value>::send(queue& helper, InsertValue&& value)
+    {
+        channel_result result = channel_result::full;
+        auto sent = [this, &value, &result]
+        {
+            return result != channel_result::full || (result = try_send(std::forward<InsertValue>(value))) != channel_result::full;
+        };
+
+        helper._wait_until(_writable, sent);
+        return result;
+    }
+
+    template <typename Value>
+    channel_result channel<Value>::try_recv(value_type& out)
+    {
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            if (_values.empty())
+            {
+                return _closed ? channel_result::closed : channel_result::empty;
+            }
+            out = std::move(_values.front());
+            _values.pop_front();
+        }
+
+        if (_capacity != 0)
+        {
+            _writable.unpark_one();
+        }
+        return channel_result::success;
+    }
+
+    template <typename Value>
+    channel_result channel<Value>::recv(value_type& out)
+    {
+        // the predicate must not receive twice once it has succeeded
+        channel_result result = channel_result::empty;
+        auto received = [this, &out, &result]
+        {
+            return result != channel_result::empty || (result = try_recv(out)) != channel_result::empty;
+        };
+
+        while (!received())
+        {
+            _readable.park_until(received);
+        }
+        return result;
+    }
+
+    template <typename Value>
+    channel_result channel<Value>::recv(queue& helper, value_type& out)
+    {
+        channel_result result = channel_result::empty;
+        auto received = [this, &out, &result]
+        {
+            return result != channel_result::empty || (result = try_recv(out)) != channel_result::empty;
+        };
+
+        helper._wait_until(_readable, received);
+        return result;
+    }
+
+    template <typename Value>
+    void channel<Value>::close()
+    {
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            _closed = true;
+        }
+
+        _readable.unpark_all();
+        _writable.unpark_all();
+    }
+
+    template <typename Value>
+    bool channel<Value>::closed() const
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        return _closed;
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_CHANNEL_H)
@@ -0,0 +1,205 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_COMBINABLE_H)
+#define _guard_JOBXX_COMBINABLE_H
+#pragma once
+
+#include "context.h"
+#include "queue.h"
+#include "spinlock.h"
+#include "_detail/cache_line.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace jobxx
+{
+
+    // one instance of T per worker, for tasks to accumulate results into
+    // without contending with one another, to be merged once they are
+    // done. each worker's instance is found by its index and has a cache
+    // line to itself; threads that have no index (see
+    // context::worker_index) each get an instance of their own too, but
+    // find it under a lock.
+    //
+    // worker indices are only unique within a queue, so a combinable
+    // belongs to the queue it is constructed for. tasks of any other
+    // queue may still use it, but are treated as threads without an
+    // index.
+    //
+    // instances are default-constructed on first use. combine, for_each
+    // and clear must not be called while tasks may still be using the
+    // combinable, e.g. until the job they belong to has been waited on.
+    template <typename T>
+    class combinable
+    {
+    public:
+        explicit combinable(queue& owner) : _queue(owner._impl), _slots(new slot[queue::max_workers]) {}
+        ~combinable() { clear(); }
+
+        combinable(combinable const&) = delete;
+        combinable& operator=(combinable const&) = delete;
+
+        // the instance of the worker running the task.
+        T& local(context const& ctx);
+
+        // merge(T const&, T const&) -> T folds every instance into one;
+        // a default-constructed T if there are none.
+        template <typename BinaryFunctionT> T combine(BinaryFunctionT&& merge) const;
+
+        template <typename FunctionT> void for_each(FunctionT&& visit);
+        template <typename FunctionT> void for_each(FunctionT&& visit) const;
+
+        // destroys every instance.
+        void clear();
+
+    private:
+        struct alignas(_detail::cache_line_size) slot
+        {
+            T* value() { return reinterpret_cast<T*>(&storage); }
+            T const* value() const { return reinterpret_cast<T const*>(&storage); }
+
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+            bool constructed = false;
+        };
+
+        _detail::queue_impl* const _queue = nullptr;
+        std::unique_ptr<slot[]> const _slots;
+
+        spinlock _others_lock;
+        std::list<std::pair<std::thread::id, T>> _others;
+    };
+
+    template <typename T>
+    T& combinable<T>::local(context const& ctx)
+    {
+        int const index = &ctx._queue == _queue ? ctx.worker_index() : -1;
+        if (index >= 0 && index < queue::max_workers)
+        {
+            slot& owned = _slots[index];
+            if (!owned.constructed)
+            {
+                new (&owned.storage) T();
+                owned.constructed = true;
+            }
+            return *owned.value();
+        }
+
+        std::thread::id const self = std::this_thread::get_id();
+        std::lock_guard<spinlock> _(_others_lock);
+        for (auto& other : _others)
+        {
+            if (other.first == self)
+            {
+                return other.second;
+            }
+        }
+        _others.emplace_back(std::piecewise_construct, std::forward_as_tuple(self), std::forward_as_tuple());
+        return _others.back().second;
+    }
+
+    template <typename T>
+    template <typename BinaryFunctionT>
+    T combinable<T>::combine(BinaryFunctionT&& merge) const
+    {
+        // the first instance is copied rather than merged into a
+        // default-constructed T, which need not be an identity for merge
+        std::unique_ptr<T> result;
+        for_each([&result, &merge](T const& value)
+        {
+            if (result == nullptr)
+            {
+                result.reset(new T(value));
+            }
+            else
+            {
+                *result = merge(static_cast<T const&>(*result), value);
+            }
+        });
+        return result != nullptr ? std::move(*result) : T();
+    }
+
+    template <typename T>
+    template <typename FunctionT>
+    void combinable<T>::for_each(FunctionT&& visit)
+    {
+        for (int index = 0; index != queue::max_workers; ++index)
+        {
+            if (_slots[index].constructed)
+            {
+                visit(*_slots[index].value());
+            }
+        }
+        for (auto& other : _others)
+        {
+            visit(other.second);
+        }
+    }
+
+    template <typename T>
+    template <typename FunctionT>
+    void combinable<T>::for_each(FunctionT&& visit) const
+    {
+        for (int index = 0; index != queue::max_workers; ++index)
+        {
+            if (_slots[index].constructed)
+            {
+                visit(*_slots[index].value());
+            }
+        }
+        for (auto const& other : _others)
+        {
+            visit(other.second);
+        }
+    }
+
+    template <typename T>
+    void combinable<T>::clear()
+    {
+        for (int index = 0; index != queue::max_workers; ++index)
+        {
+            if (_slots[index].constructed)
+            {
+                _slots[index].value()->~T();
+                _slots[index].constructed = false;
+            }
+        }
+        _others.clear();
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_COMBINABLE_H)
@@ -32,6 +32,7 @@
 #define _guard_JOBXX_CONCURRENT_QUEUE_H
 #pragma once
 
+#include <cstddef>
 #include <mutex>
 #include <deque>
 
@@ -48,6 +49,12 @@ namespace jobxx
         inline bool pop_front(value_type& out);
         inline bool maybe_empty() const;
 
+        // batched forms, under a single lock: pop_front takes up to
+        // max_count values and returns how many it took, and push_front
+        // puts values back ahead of the rest, in the same order.
+        inline std::size_t pop_front(value_type* out, std::size_t max_count);
+        inline void push_front(value_type* values, std::size_t count);
+
     private:
         // FIXME: temporary "just works" data-structure to be
         // replaced by "lock-free" structure
@@ -79,6 +86,29 @@ namespace jobxx
         }
     }
 
+    template <typename Value>
+    std::size_t concurrent_queue<Value>::pop_front(value_type* out, std::size_t max_count)
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        std::size_t count = 0;
+        while (count != max_count && !_queue.empty())
+        {
+            out[count++] = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        return count;
+    }
+
+    template <typename Value>
+    void concurrent_queue<Value>::push_front(value_type* values, std::size_t count)
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        while (count != 0)
+        {
+            _queue.push_front(std::move(values[--count]));
+        }
+    }
+
     template <typename Value>
     bool concurrent_queue<Value>::maybe_empty() const
     {
@@ -33,6 +33,8 @@
 #pragma once
 
 #include "delegate.h"
+#include "job.h"
+#include <cstddef>
 
 namespace jobxx
 {
@@ -41,6 +43,7 @@ namespace jobxx
     {
         struct job_impl;
         struct queue_impl;
+        struct join_access;
     }
 
     enum class spawn_result;
@@ -54,10 +57,48 @@ namespace jobxx
         context& operator=(context const&) = delete;
 
         spawn_result spawn_task(delegate&& work);
+        spawn_result spawn_task_blocking(delegate&& work);
+        spawn_result spawn_task_on(int worker, delegate&& work);
+        spawn_result spawn_urgent_task(delegate&& work);
+
+        // the id of the worker running the task (see queue::max_workers),
+        // or -1 on a thread that has none, such as one merely calling
+        // work_one, a worker of an urgent_lane, or a spare worker of an
+        // elastic_pool started while every id was taken.
+        int worker_index() const;
+
+        // one more than the highest worker id handed out so far, which
+        // grows as threads call work_forever, never past max_workers.
+        int worker_count() const;
+
+        // the job this task belongs to, or an empty (complete) job for a
+        // task that has none. a task must not wait on its own job.
+        job current_job() const;
+
+        // a slot for whatever the task wishes to keep with its context,
+        // e.g. to hand to functions it calls; nullptr until set. a half
+        // of a join that another worker steals has a context, and so a
+        // slot, of its own; see join.
+        void* user_data() const { return _user_data; }
+        void set_user_data(void* data) { _user_data = data; }
+
+        // true if the job this task belongs to has been cancelled.
+        bool cancelled() const;
+
+        // scratch memory that lives until every task of the job has
+        // completed, at which point it is all released at once; it is
+        // never freed individually. returns nullptr for tasks that don't
+        // belong to a job. alignment must be a power of two.
+        void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
 
     private:
         _detail::queue_impl& _queue;
         _detail::job_impl* _job = nullptr;
+        void* _user_data = nullptr;
+
+        friend class reactor;
+        template <typename T> friend class combinable;
+        friend struct _detail::join_access;
     };
 
 }
@@ -46,7 +46,7 @@ namespace jobxx
         struct takes_context : std::false_type {};
 
         template <typename FunctionT>
-        struct takes_context<FunctionT, std::void_t<decltype(std::declval<FunctionT>()(std::declval<context>()))>> : std::true_type {};
+        struct takes_context<FunctionT, std::void_t<decltype(std::declval<FunctionT>()(std::declval<context&>()))>> : std::true_type {};
 
         template <typename FunctionT>
         constexpr bool takes_context_v = takes_context<FunctionT>();
@@ -0,0 +1,112 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_ELASTIC_POOL_H)
+#define _guard_JOBXX_ELASTIC_POOL_H
+#pragma once
+
+#include "delegate.h"
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobxx
+{
+
+    class queue;
+    enum class spawn_result;
+
+    // a set of worker threads running a queue that keeps the number of
+    // workers that aren't blocked at the requested parallelism. a task
+    // about to block enters a blocking_region (or is spawned with
+    // spawn_blocking), and a spare worker is started to stand in for it.
+    // spares retire once they have been idle for idle_timeout while there
+    // are more unblocked workers than needed.
+    //
+    // destroying the pool closes the queue.
+    class elastic_pool
+    {
+    public:
+        // a parallelism of 0 means one worker per hardware thread.
+        explicit elastic_pool(queue& queue, int parallelism = 0, std::chrono::milliseconds idle_timeout = std::chrono::milliseconds(100));
+        ~elastic_pool();
+
+        elastic_pool(elastic_pool const&) = delete;
+        elastic_pool& operator=(elastic_pool const&) = delete;
+
+        class blocking_region
+        {
+        public:
+            explicit blocking_region(elastic_pool& pool);
+            ~blocking_region();
+
+            blocking_region(blocking_region const&) = delete;
+            blocking_region& operator=(blocking_region const&) = delete;
+
+        private:
+            elastic_pool& _pool;
+        };
+
+        // spawns a task that runs inside a blocking_region.
+        spawn_result spawn_blocking(delegate&& work);
+
+        // the number of worker threads, blocked or not.
+        int workers() const { return _workers.load(std::memory_order_relaxed); }
+
+    private:
+        struct spare
+        {
+            std::thread thread;
+            std::atomic<bool> done = false;
+        };
+
+        void _compensate();
+        bool _retire();
+
+        queue& _queue;
+        int const _parallelism = 0;
+        std::chrono::milliseconds const _idle_timeout;
+
+        std::atomic<int> _workers = 0;
+        std::atomic<int> _blocked = 0;
+
+        std::vector<std::thread> _core;
+
+        std::mutex _lock;
+        std::list<spare> _spares;
+        bool _stopping = false;
+    };
+
+}
+
+#endif // defined(_guard_JOBXX_ELASTIC_POOL_H)
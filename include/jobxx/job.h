@@ -32,12 +32,31 @@
 #define _guard_JOBXX_JOB_H
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+
 namespace jobxx
 {
 
-    namespace _detail { struct job_impl; }
+    namespace _detail { struct job_impl; struct sender_access; }
     class queue;
 
+    // what the tasks of named jobs have cost; see queue::create_job.
+    // cpu_time is the time the threads running them spent on the CPU,
+    // as measured by GetThreadTimes on Windows and CLOCK_THREAD_CPUTIME_ID
+    // elsewhere; where neither is available it is the wall-clock time
+    // they ran for, which includes any time they were blocked or
+    // preempted. a task that runs others while it waits is charged only
+    // for the time it spent itself.
+    struct job_stats
+    {
+        // the number of jobs covered; 1 for a job's own figures.
+        std::uint64_t jobs = 0;
+        std::uint64_t tasks = 0;
+        std::chrono::nanoseconds cpu_time = std::chrono::nanoseconds::zero();
+        std::chrono::nanoseconds max_task_time = std::chrono::nanoseconds::zero();
+    };
+
     class job
     {
     public:
@@ -51,12 +70,24 @@ namespace jobxx
         job& operator=(job&& rhs);
 
         bool complete() const;
+
+        // request that the job's remaining tasks not run; tasks already
+        // running may observe this via context::cancelled() and bail out.
+        // the job still completes normally once its tasks are drained.
+        void cancel();
+        bool cancelled() const;
+
+        // the cost of the job's tasks so far, if it is named; figures
+        // are gathered by each worker and may lag until it goes idle
+        // or moves on to another job, but are complete once the job is.
+        job_stats stats() const;
         explicit operator bool() const { return complete(); }
 
     private:
         _detail::job_impl* _impl = nullptr;
 
         friend queue;
+        friend struct _detail::sender_access;
     };
     
 }
@@ -0,0 +1,135 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_JOIN_H)
+#define _guard_JOBXX_JOIN_H
+#pragma once
+
+#include "context.h"
+#include "park.h"
+#include "predicate.h"
+#include "_detail/task.h"
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+namespace jobxx
+{
+
+    namespace _detail
+    {
+
+        struct join_access
+        {
+            // offers the node to idle workers; false if it can't be,
+            // in which case the caller must run it itself.
+            static bool push(context& ctx, task& node);
+            // takes the node back, unless a worker has stolen it.
+            static bool pop(context& ctx, task& node);
+            static void wait(context& ctx, park& target, predicate ready);
+            // a context for a stolen half: the same queue and job, but
+            // state of its own, as it runs alongside the first half.
+            static context fork(context const& ctx) { return context(ctx._queue, ctx._job); }
+        };
+
+        struct join_frame
+        {
+            // 1 once a stolen half has run, 2 once its thief is
+            // done touching the frame.
+            std::atomic<int> stage = 0;
+            park waiting;
+        };
+
+        template <typename FunctionT>
+        void invoke_with(FunctionT& func, context& ctx)
+        {
+            if constexpr (std::is_invocable<FunctionT&, context&>::value)
+            {
+                func(ctx);
+            }
+            else
+            {
+                func();
+            }
+        }
+
+    }
+
+    // runs first and second, potentially in parallel, and returns once
+    // both have completed. either may take the context to join further;
+    // a second half that another worker steals gets a context of its own,
+    // for the same job, so that its user data isn't shared with first.
+    //
+    // second is offered to idle workers while first runs on the calling
+    // thread; unless it was stolen in the meantime, it then runs here
+    // too. nothing is allocated, and a job's task count is untouched,
+    // so joining is cheap enough to recurse down to small pieces of work.
+    // on threads that aren't workers of the queue, both simply run here.
+    template <typename FirstT, typename SecondT>
+    void join(context& ctx, FirstT&& first, SecondT&& second)
+    {
+        _detail::join_frame frame;
+        auto run_stolen = [&second, &ctx, &frame]()
+        {
+            context stolen = _detail::join_access::fork(ctx);
+            _detail::invoke_with(second, stolen);
+            frame.stage.store(1, std::memory_order_release);
+            frame.waiting.unpark_all();
+            frame.stage.store(2, std::memory_order_release);
+        };
+        _detail::task node{run_stolen, nullptr, /*owned=*/false};
+
+        if (!_detail::join_access::push(ctx, node))
+        {
+            _detail::invoke_with(first, ctx);
+            _detail::invoke_with(second, ctx);
+            return;
+        }
+
+        _detail::invoke_with(first, ctx);
+
+        if (_detail::join_access::pop(ctx, node))
+        {
+            _detail::invoke_with(second, ctx);
+            return;
+        }
+
+        // stolen, so help out until the thief is done
+        auto stolen_complete = [&frame]{ return frame.stage.load(std::memory_order_acquire) != 0; };
+        _detail::join_access::wait(ctx, frame.waiting, stolen_complete);
+        while (frame.stage.load(std::memory_order_acquire) != 2)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_JOIN_H)
@@ -32,19 +32,38 @@
 #define _guard_JOBXX_PARK_H
 #pragma once
 
-#include "spinlock.h"
 #include "predicate.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 
 namespace jobxx
 {
 
     enum class park_result
     {
+        timeout = -2,
         failure = -1,
         first = 0,
         second = 1
     };
 
+    class park;
+
+    namespace _detail
+    {
+        struct parked_node;
+        struct parked_thread;
+    }
+
+    // one of the parks a thread may be parked on by park::park_until_any.
+    struct park_target
+    {
+        park* target = nullptr;
+        predicate pred;
+    };
+
     class park
     {
     public:
@@ -57,29 +76,48 @@ namespace jobxx
         park_result park_until(predicate pred) { return _park(this, pred); }
         static park_result park_until(park& first, predicate first_pred, park& second, predicate second_pred) { return _park(&first, first_pred, &second, second_pred); }
 
+        // as park_until, but gives up and returns park_result::timeout if
+        // the thread has not been unparked before the timeout elapses.
+        template <typename Rep, typename Period> park_result park_until_for(predicate pred, std::chrono::duration<Rep, Period> const& timeout) { return _park(this, pred, nullptr, predicate(), _deadline(timeout)); }
+        template <typename Rep, typename Period> static park_result park_until_for(park& first, predicate first_pred, park& second, predicate second_pred, std::chrono::duration<Rep, Period> const& timeout) { return _park(&first, first_pred, &second, second_pred, _deadline(timeout)); }
+
+        // parks on any number of parks at once; the thread is awoken exactly
+        // once, and the result (when not a failure or timeout) is the index
+        // of the target that unparked it or whose predicate was satisfied.
+        static park_result park_until_any(park_target const* targets, std::size_t count) { return _park(targets, count, clock::time_point::max()); }
+        template <typename Rep, typename Period> static park_result park_until_any_for(park_target const* targets, std::size_t count, std::chrono::duration<Rep, Period> const& timeout) { return _park(targets, count, _deadline(timeout)); }
+
         bool unpark_one();
         void unpark_all();
 
     private:
-        struct thread_state;
-        struct parked_node
-        {
-            thread_state* _thread = nullptr;
-            parked_node* _next = this;
-            parked_node* _prev = this;
-            int _id = 0;
-        };
-
-        static park_result _park(park* first, predicate first_pred, park* second = nullptr, predicate second_pred = predicate());
-
-        bool _unpark(thread_state& thread);
-        void _link(parked_node& node);
-        void _unlink(parked_node& node);
-        
-        spinlock _lock;
-        parked_node _parked;
+        using clock = std::chrono::steady_clock;
+
+        using thread_state = _detail::parked_thread;
+        using parked_node = _detail::parked_node;
+
+        static inline park_result _park(park* first, predicate first_pred, park* second = nullptr, predicate second_pred = predicate(), clock::time_point deadline = clock::time_point::max());
+        static park_result _park(park_target const* targets, std::size_t count, clock::time_point deadline);
+
+        template <typename Rep, typename Period> static clock::time_point _deadline(std::chrono::duration<Rep, Period> const& timeout) { return clock::now() + std::chrono::duration_cast<clock::duration>(timeout); }
+
+        static bool _unpark(parked_node& node);
+        void _push(parked_node& node);
+        parked_node* _pop();
+
+        // parked threads, as a Treiber stack whose head is tagged
+        // against ABA; see park.cc.
+        std::atomic<std::uint64_t> _head = 0;
+
+        friend _detail::parked_thread;
     };
 
+    park_result park::_park(park* first, predicate first_pred, park* second, predicate second_pred, clock::time_point deadline)
+    {
+        park_target const targets[2] = {{first, first_pred}, {second, second_pred}};
+        return _park(targets, second != nullptr ? 2 : 1, deadline);
+    }
+
 }
 
 #endif // defined(_guard_JOBXX_PARK_H)
@@ -0,0 +1,141 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_PIPELINE_H)
+#define _guard_JOBXX_PIPELINE_H
+#pragma once
+
+#include "spinlock.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jobxx
+{
+
+    class queue;
+    class context;
+
+    enum class stage_mode
+    {
+        // any number of items may be in the stage at once
+        parallel,
+        // one item at a time, in the order the input stage produced them
+        serial_in_order,
+        // one item at a time, in whatever order they arrive
+        serial_out_of_order
+    };
+
+    // a stream of items pushed through a sequence of stages, each stage
+    // running as tasks on a queue. items are opaque pointers: the first
+    // stage is the input, whose mode is ignored as it is always run
+    // serially; it is called with nullptr, returning
+    // the next item or nullptr at the end of the stream; every later stage
+    // transforms an item into the one handed to the next stage. a stage
+    // returning nullptr drops the item from all later stages.
+    //
+    // at most max_tokens items are in flight at once, and a thread that
+    // finishes one stage of an item carries it straight into the next
+    // stage, so an item tends to flow through the pipeline on one core.
+    class pipeline
+    {
+    public:
+        pipeline() = default;
+
+        pipeline(pipeline const&) = delete;
+        pipeline& operator=(pipeline const&) = delete;
+
+        template <typename FilterT> void add_stage(stage_mode mode, FilterT&& filter);
+
+        // runs the stream to completion, working on the queue while waiting.
+        void run(queue& queue, std::size_t max_tokens);
+
+    private:
+        struct filter_base
+        {
+            virtual ~filter_base() = default;
+            virtual void* operator()(void* item) = 0;
+        };
+
+        template <typename FilterT>
+        struct filter_impl : filter_base
+        {
+            explicit filter_impl(FilterT&& filter) : _filter(std::forward<FilterT>(filter)) {}
+            void* operator()(void* item) override { return _filter(item); }
+
+            std::decay_t<FilterT> _filter;
+        };
+
+        struct item_state;
+
+        struct stage
+        {
+            stage_mode mode = stage_mode::parallel;
+            std::unique_ptr<filter_base> filter;
+
+            // serial stages only
+            spinlock lock;
+            bool busy = false;
+            std::size_t next_sequence = 0;
+            std::deque<item_state*> waiting;
+        };
+
+        void _input(context& ctx);
+        void _process(context& ctx, item_state* item);
+        bool _enter(stage& stage, item_state* item);
+        item_state* _leave(stage& stage);
+        void _schedule_input(context& ctx);
+
+        std::vector<std::unique_ptr<stage>> _stages;
+
+        // per-run state
+        std::atomic<std::size_t> _tokens = 0;
+        spinlock _input_lock;
+        bool _input_done = false;
+        bool _input_scheduled = false;
+        std::size_t _input_sequence = 0;
+    };
+
+    template <typename FilterT>
+    void pipeline::add_stage(stage_mode mode, FilterT&& filter)
+    {
+        std::unique_ptr<stage> added(new stage);
+        added->mode = mode;
+        added->filter.reset(new filter_impl<FilterT>(std::forward<FilterT>(filter)));
+        _stages.push_back(std::move(added));
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_PIPELINE_H)
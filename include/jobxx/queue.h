@@ -35,34 +35,117 @@
 #include "delegate.h"
 #include "job.h"
 #include "context.h"
+#include "predicate.h"
+#include <chrono>
+#include <cstddef>
 #include <utility>
 
 namespace jobxx
 {
 
-    namespace _detail { struct queue_impl; }
+    namespace _detail { struct queue_impl; struct sender_access; }
+
+    class park;
+    class scheduler;
 
     enum class spawn_result
     {
         success,
         queue_full,
         empty_function,
-        queue_closed
+        queue_closed,
+        invalid_worker,
+        invalid_payload,
+        invalid_reactor
+    };
+
+    enum class wait_result
+    {
+        complete,
+        timeout
+    };
+
+    // optional bound on the number of tasks waiting in a queue. a full
+    // queue refuses spawn_task with spawn_result::queue_full, while
+    // spawn_task_blocking runs queued work until there is room.
+    struct queue_capacity
+    {
+        // 0 means unbounded.
+        std::size_t max_tasks = 0;
+
+        // on_watermark is invoked with true when the number of waiting
+        // tasks rises to high_watermark, and then with false once it
+        // falls back to low_watermark. 0 disables the notifications.
+        std::size_t high_watermark = 0;
+        std::size_t low_watermark = 0;
+        void(*on_watermark)(void* user_data, bool high) = nullptr;
+        void* user_data = nullptr;
+
+        // a task spawned by one of the queue's workers is run right away,
+        // by that worker, rather than queued, once at least this many
+        // tasks are already waiting, or when no worker is idle and the
+        // spawning worker already has a task of its own lined up. this
+        // keeps fine-grained recursive code from burying the queue in
+        // tasks no one is free to run. 0 always queues.
+        std::size_t inline_threshold = 0;
     };
 
     class queue
     {
     public:
+        // workers are identified by small integers: the thread that
+        // created the queue is always main_thread, and each thread that
+        // calls work_forever takes the next id in turn.
+        static constexpr int main_thread = 0;
+        static constexpr int max_workers = 64;
+
         queue();
+        explicit queue(queue_capacity const& capacity);
         ~queue();
 
         queue(queue const&) = delete;
         queue& operator=(queue const&) = delete;
 
         template <typename InitFunctionT> job create_job(InitFunctionT&& initializer);
+
+        // creates a job whose tasks are accounted for, see job::stats,
+        // and also adds to the totals for every job of the same name,
+        // see stats_for.
+        template <typename InitFunctionT> job create_job(char const* name, InitFunctionT&& initializer);
         spawn_result spawn_task(delegate&& work);
+        spawn_result spawn_task_blocking(delegate&& work);
+
+        // spawn a task that only the given worker will run. tasks for
+        // main_thread are run by work_one/work_all/etc. on that thread.
+        // other ids are refused with invalid_worker until a thread has
+        // taken them in work_forever; tasks left for a worker that has
+        // since returned from work_forever are run by the others. ids
+        // are reused, so a later worker may take over a departed one's.
+        spawn_result spawn_task_on(int worker, delegate&& work);
+
+        // spawn a task into the urgent lane, which every worker looks at
+        // before any other work, and which the workers of an urgent_lane
+        // wait on alone. urgent tasks ignore the queue's capacity.
+        spawn_result spawn_urgent_task(delegate&& work);
 
         void wait_job_actively(job const& awaited);
+        template <typename Rep, typename Period> wait_result wait_job_for(job const& awaited, std::chrono::duration<Rep, Period> const& timeout);
+        template <typename Clock, typename Duration> wait_result wait_job_until(job const& awaited, std::chrono::time_point<Clock, Duration> const& deadline);
+
+        // wait (actively) until one of the jobs is complete, returning its index.
+        // count must not be zero.
+        template <typename... JobT> std::size_t wait_any(job const& first, JobT const&... rest);
+        std::size_t wait_any(job const* const* jobs, std::size_t count);
+        // wait (actively) until every one of the jobs is complete.
+        template <typename... JobT> void wait_all(job const& first, JobT const&... rest);
+        void wait_all(job const* const* jobs, std::size_t count);
+
+        // totals for the jobs of the given name, including every task
+        // of those that are complete.
+        job_stats stats_for(char const* name);
+
+        // see sender.h
+        scheduler get_scheduler();
 
         bool work_one();
         void work_all();
@@ -71,20 +154,99 @@ namespace jobxx
         void close();
 
     private:
-        _detail::job_impl* _create_job();
+        using clock = std::chrono::steady_clock;
+
+        _detail::job_impl* _create_job(char const* name = nullptr);
+        void _submit_job(_detail::job_impl* job_impl);
+        wait_result _wait_job(job const& awaited, clock::time_point deadline);
+
+        // runs queued tasks until one of the jobs is complete, returning
+        // its index, or until all of them are, returning count.
+        std::size_t _wait_jobs(job const* const* jobs, std::size_t count, bool all);
+
+        // runs queued tasks until ready returns true, sleeping on target
+        // (or the queue) when there is nothing to do. ready must keep
+        // returning true once it has done so.
+        void _wait_until(park& target, predicate ready);
+
+        // runs tasks as work_forever does, taking a worker id if one is
+        // free, and returns once it has been idle for idle_timeout and
+        // retire agrees, or the queue is closed.
+        void _work_until_retired(clock::duration idle_timeout, predicate retire);
+
+        // gives up any tasks the calling worker holds but has yet to run,
+        // its batch and its LIFO slot, for when it is about to block for
+        // a while.
+        void _release_held_tasks();
+
+        // runs urgent tasks until stop returns true or the queue is
+        // closed, and after each time the lane empties, other tasks for
+        // as long as bulk_slice. see urgent_lane.
+        void _work_urgent(clock::duration bulk_slice, predicate stop);
+        // wakes every thread in _work_urgent so it may check stop.
+        void _wake_urgent();
 
         _detail::queue_impl* _impl = nullptr;
+
+        friend class elastic_pool;
+        friend class reactor;
+        friend class task_mutex;
+        friend class urgent_lane;
+        template <typename Value> friend class channel;
+        template <typename T> friend class combinable;
+        friend struct _detail::sender_access;
     };
 
     template <typename InitFunctionT>
     job queue::create_job(InitFunctionT&& initializer)
     {
+        // the job is held open while the initializer runs, so that it
+        // completes only once, however soon its first tasks finish.
         _detail::job_impl* job_impl = _create_job();
         context ctx(*_impl, job_impl);
         initializer(ctx);
+        _submit_job(job_impl);
+        return job(job_impl);
+    }
+
+    template <typename InitFunctionT>
+    job queue::create_job(char const* name, InitFunctionT&& initializer)
+    {
+        _detail::job_impl* job_impl = _create_job(name);
+        context ctx(*_impl, job_impl);
+        initializer(ctx);
+        _submit_job(job_impl);
         return job(job_impl);
     }
 
+    template <typename Rep, typename Period>
+    wait_result queue::wait_job_for(job const& awaited, std::chrono::duration<Rep, Period> const& timeout)
+    {
+        return _wait_job(awaited, clock::now() + std::chrono::duration_cast<clock::duration>(timeout));
+    }
+
+    template <typename Clock, typename Duration>
+    wait_result queue::wait_job_until(job const& awaited, std::chrono::time_point<Clock, Duration> const& deadline)
+    {
+        // the deadline may be on any clock, but parking is
+        // always done relative to the steady clock.
+        return _wait_job(awaited, clock::now() + std::chrono::duration_cast<clock::duration>(deadline - Clock::now()));
+    }
+
+    template <typename... JobT>
+    std::size_t queue::wait_any(job const& first, JobT const&... rest)
+    {
+        job const* const jobs[] = {&first, &rest...};
+        return wait_any(jobs, 1 + sizeof...(rest));
+    }
+
+    template <typename... JobT>
+    void queue::wait_all(job const& first, JobT const&... rest)
+    {
+        job const* const jobs[] = {&first, &rest...};
+        wait_all(jobs, 1 + sizeof...(rest));
+    }
+
 }
 
 #endif // defined(_guard_JOBXX_QUEUE_H)
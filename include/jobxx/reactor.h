@@ -0,0 +1,109 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_REACTOR_H)
+#define _guard_JOBXX_REACTOR_H
+#pragma once
+
+#if defined(__linux__)
+
+#include "delegate.h"
+#include <atomic>
+#include <cstddef>
+
+namespace jobxx
+{
+
+    class queue;
+    class context;
+    enum class spawn_result;
+
+    namespace _detail { struct queue_impl; }
+
+    // an asynchronous read or write, owned by the caller until its
+    // continuation runs.
+    struct io_request
+    {
+        int fd = -1;
+        void* buffer = nullptr;
+        std::size_t size = 0;
+
+        // the number of bytes transferred, or -errno on failure;
+        // set before the continuation is spawned.
+        long result = 0;
+    };
+
+    // epoll-based I/O integrated with a queue's workers: while it exists,
+    // one idle worker of the queue sleeps in the reactor rather than in
+    // the queue's park, and I/O completions spawn continuation tasks.
+    // an operation completes with a single read()/write() once its file
+    // descriptor is ready; regular files are always ready, and so their
+    // operations complete immediately. only one operation may be pending
+    // per file descriptor at a time (dup() a socket to read and write it
+    // concurrently).
+    //
+    // only workers in work_forever sleep in the reactor, so a queue that
+    // is only ever run by work_one, wait_job_actively and the like never
+    // completes any I/O.
+    //
+    // destroying the reactor completes the operations still pending with
+    // a result of -ECANCELED, running their continuations right there.
+    class reactor
+    {
+    public:
+        explicit reactor(queue& queue);
+        ~reactor();
+
+        reactor(reactor const&) = delete;
+        reactor& operator=(reactor const&) = delete;
+
+        // false if the reactor couldn't get the file descriptors it needs,
+        // in which case every operation fails with invalid_reactor.
+        bool valid() const { return _impl != nullptr; }
+
+        spawn_result read(io_request& request, delegate&& continuation);
+        spawn_result write(io_request& request, delegate&& continuation);
+
+        // as above, but the continuation is a task of the context's job,
+        // which does not complete until the operation has.
+        spawn_result read(context& ctx, io_request& request, delegate&& continuation);
+        spawn_result write(context& ctx, io_request& request, delegate&& continuation);
+
+    private:
+        struct impl;
+
+        impl* _impl = nullptr;
+    };
+
+}
+
+#endif // defined(__linux__)
+
+#endif // defined(_guard_JOBXX_REACTOR_H)
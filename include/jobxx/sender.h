@@ -0,0 +1,490 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_SENDER_H)
+#define _guard_JOBXX_SENDER_H
+#pragma once
+
+#include "job.h"
+#include "park.h"
+#include "predicate.h"
+#include "queue.h"
+#include "_detail/task.h"
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// senders and receivers in the style of P2300, over jobxx queues and jobs.
+//
+// this is a small, self-contained subset rather than an implementation of
+// std::execution: a sender has a single value completion, described by its
+// values member type (a std::tuple), and is consumed by an rvalue call to
+// its connect(receiver) member, which returns a non-movable operation
+// state to start(). a receiver has set_value(values...), set_error(
+// spawn_result) and set_stopped() members.
+//
+// every operation state embeds the task it spawns, so a chain of schedule,
+// then and when_all allocates nothing per step.
+
+namespace jobxx
+{
+
+    namespace _detail
+    {
+
+        struct sender_access
+        {
+            static spawn_result spawn(queue& target, task& node);
+            // false if the job has already completed, in which case the
+            // node will not be spawned.
+            static bool await(job const& awaited, task& node);
+            static void wait(queue& helper, park& target, predicate ready);
+        };
+
+        template <typename SenderT, typename ReceiverT>
+        using connect_result_t = decltype(std::declval<SenderT>().connect(std::declval<ReceiverT>()));
+
+        template <typename SenderT>
+        using values_of = typename std::remove_reference_t<SenderT>::values;
+
+    }
+
+    // -- schedule: completes with no values on one of the queue's workers.
+
+    template <typename ReceiverT>
+    class schedule_operation
+    {
+    public:
+        schedule_operation(queue& target, ReceiverT receiver) : _queue(target), _receiver(std::move(receiver)) {}
+
+        schedule_operation(schedule_operation const&) = delete;
+        schedule_operation& operator=(schedule_operation const&) = delete;
+
+        void start()
+        {
+            spawn_result const result = _detail::sender_access::spawn(_queue, _node);
+            if (result != spawn_result::success)
+            {
+                _receiver.set_error(result);
+            }
+        }
+
+    private:
+        queue& _queue;
+        ReceiverT _receiver;
+        _detail::task _node{[this](){ _receiver.set_value(); }, nullptr, /*owned=*/false};
+    };
+
+    class schedule_sender
+    {
+    public:
+        using values = std::tuple<>;
+
+        explicit schedule_sender(queue& target) : _queue(&target) {}
+
+        template <typename ReceiverT>
+        schedule_operation<ReceiverT> connect(ReceiverT receiver) && { return schedule_operation<ReceiverT>(*_queue, std::move(receiver)); }
+
+    private:
+        queue* _queue = nullptr;
+    };
+
+    class scheduler
+    {
+    public:
+        explicit scheduler(queue& target) : _queue(&target) {}
+
+        schedule_sender schedule() const { return schedule_sender(*_queue); }
+
+        bool operator==(scheduler const& rhs) const { return _queue == rhs._queue; }
+        bool operator!=(scheduler const& rhs) const { return _queue != rhs._queue; }
+
+    private:
+        queue* _queue = nullptr;
+    };
+
+    // -- as_sender: completes with no values once the job does, on the
+    // worker that ran its last task, or with set_stopped if the job was
+    // cancelled. the job must outlive the operation.
+
+    template <typename ReceiverT>
+    class job_operation
+    {
+    public:
+        job_operation(job const& awaited, ReceiverT receiver) : _job(awaited), _receiver(std::move(receiver)) {}
+
+        job_operation(job_operation const&) = delete;
+        job_operation& operator=(job_operation const&) = delete;
+
+        void start()
+        {
+            if (!_detail::sender_access::await(_job, _node))
+            {
+                _complete();
+            }
+        }
+
+    private:
+        void _complete()
+        {
+            if (_job.cancelled())
+            {
+                _receiver.set_stopped();
+            }
+            else
+            {
+                _receiver.set_value();
+            }
+        }
+
+        job const& _job;
+        ReceiverT _receiver;
+        _detail::task _node{[this](){ _complete(); }, nullptr, /*owned=*/false};
+    };
+
+    class job_sender
+    {
+    public:
+        using values = std::tuple<>;
+
+        explicit job_sender(job const& awaited) : _job(&awaited) {}
+
+        template <typename ReceiverT>
+        job_operation<ReceiverT> connect(ReceiverT receiver) && { return job_operation<ReceiverT>(*_job, std::move(receiver)); }
+
+    private:
+        job const* _job = nullptr;
+    };
+
+    inline job_sender as_sender(job const& awaited) { return job_sender(awaited); }
+
+    // -- then: passes the values of a sender through a function, on
+    // whichever thread the sender completed.
+
+    namespace _detail
+    {
+
+        template <typename FunctionT, typename ValuesT> struct then_values;
+
+        template <typename FunctionT, typename... ValueT>
+        struct then_values<FunctionT, std::tuple<ValueT...>>
+        {
+            using result = std::invoke_result_t<FunctionT&, ValueT...>;
+            using type = std::conditional_t<std::is_void<result>::value, std::tuple<>, std::tuple<result>>;
+        };
+
+        template <typename OperationT>
+        struct then_receiver
+        {
+            OperationT* op = nullptr;
+
+            template <typename... ValueT> void set_value(ValueT&&... values) { op->_value(std::forward<ValueT>(values)...); }
+            void set_error(spawn_result error) { op->_receiver.set_error(error); }
+            void set_stopped() { op->_receiver.set_stopped(); }
+        };
+
+    }
+
+    template <typename SenderT, typename FunctionT, typename ReceiverT>
+    class then_operation
+    {
+    public:
+        then_operation(SenderT&& sender, FunctionT&& func, ReceiverT receiver) :
+            _func(std::move(func)),
+            _receiver(std::move(receiver)),
+            _inner(std::move(sender).connect(_detail::then_receiver<then_operation>{this})) {}
+
+        then_operation(then_operation const&) = delete;
+        then_operation& operator=(then_operation const&) = delete;
+
+        void start() { _inner.start(); }
+
+    private:
+        template <typename... ValueT>
+        void _value(ValueT&&... values)
+        {
+            if constexpr (std::is_void<std::invoke_result_t<FunctionT&, ValueT...>>::value)
+            {
+                _func(std::forward<ValueT>(values)...);
+                _receiver.set_value();
+            }
+            else
+            {
+                _receiver.set_value(_func(std::forward<ValueT>(values)...));
+            }
+        }
+
+        FunctionT _func;
+        ReceiverT _receiver;
+        _detail::connect_result_t<SenderT, _detail::then_receiver<then_operation>> _inner;
+
+        friend struct _detail::then_receiver<then_operation>;
+    };
+
+    template <typename SenderT, typename FunctionT>
+    class then_sender
+    {
+    public:
+        using values = typename _detail::then_values<FunctionT, _detail::values_of<SenderT>>::type;
+
+        then_sender(SenderT&& sender, FunctionT&& func) : _sender(std::move(sender)), _func(std::move(func)) {}
+
+        template <typename ReceiverT>
+        then_operation<SenderT, FunctionT, ReceiverT> connect(ReceiverT receiver) && { return then_operation<SenderT, FunctionT, ReceiverT>(std::move(_sender), std::move(_func), std::move(receiver)); }
+
+    private:
+        SenderT _sender;
+        FunctionT _func;
+    };
+
+    template <typename SenderT, typename FunctionT>
+    then_sender<std::decay_t<SenderT>, std::decay_t<FunctionT>> then(SenderT&& sender, FunctionT&& func)
+    {
+        return then_sender<std::decay_t<SenderT>, std::decay_t<FunctionT>>(std::move(sender), std::decay_t<FunctionT>(std::forward<FunctionT>(func)));
+    }
+
+    // -- when_all: completes once every sender has, with all of their
+    // values in order. if any of them fails or stops, so does the whole,
+    // but only after the rest have completed too. with no senders at all
+    // it completes at once, with no values.
+
+    namespace _detail
+    {
+
+        template <typename OperationT, std::size_t Index>
+        struct when_all_receiver
+        {
+            OperationT* op = nullptr;
+
+            template <typename... ValueT> void set_value(ValueT&&... values)
+            {
+                std::get<Index>(op->_values).emplace(std::forward<ValueT>(values)...);
+                op->_arrive();
+            }
+            void set_error(spawn_result error) { op->_fail(error); }
+            void set_stopped() { op->_stop(); }
+        };
+
+        // the children's operation states, each constructed in place
+        // since none of them can be moved.
+        template <typename OperationT, std::size_t Index, typename... SenderT>
+        struct when_all_children
+        {
+            explicit when_all_children(OperationT*) {}
+            void start() {}
+        };
+
+        template <typename OperationT, std::size_t Index, typename FirstT, typename... RestT>
+        struct when_all_children<OperationT, Index, FirstT, RestT...>
+        {
+            when_all_children(OperationT* op, FirstT&& first, RestT&&... rest) :
+                head(std::move(first).connect(when_all_receiver<OperationT, Index>{op})),
+                tail(op, std::move(rest)...) {}
+
+            void start()
+            {
+                head.start();
+                tail.start();
+            }
+
+            connect_result_t<FirstT, when_all_receiver<OperationT, Index>> head;
+            when_all_children<OperationT, Index + 1, RestT...> tail;
+        };
+
+    }
+
+    template <typename ReceiverT, typename... SenderT>
+    class when_all_operation
+    {
+    public:
+        when_all_operation(ReceiverT receiver, SenderT&&... senders) :
+            _receiver(std::move(receiver)),
+            _children(this, std::move(senders)...) {}
+
+        when_all_operation(when_all_operation const&) = delete;
+        when_all_operation& operator=(when_all_operation const&) = delete;
+
+        void start()
+        {
+            // no child will ever arrive to complete us
+            if constexpr (sizeof...(SenderT) == 0)
+            {
+                _receiver.set_value();
+            }
+            else
+            {
+                _children.start();
+            }
+        }
+
+    private:
+        enum outcome { succeeded, failed, stopped };
+
+        void _arrive()
+        {
+            if (_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                switch (_outcome.load(std::memory_order_relaxed))
+                {
+                case failed: _receiver.set_error(_error); break;
+                case stopped: _receiver.set_stopped(); break;
+                default: _complete(std::index_sequence_for<SenderT...>()); break;
+                }
+            }
+        }
+
+        // the first failure or stop decides the outcome
+        void _fail(spawn_result error)
+        {
+            int expected = succeeded;
+            if (_outcome.compare_exchange_strong(expected, failed, std::memory_order_relaxed))
+            {
+                _error = error;
+            }
+            _arrive();
+        }
+
+        void _stop()
+        {
+            int expected = succeeded;
+            _outcome.compare_exchange_strong(expected, stopped, std::memory_order_relaxed);
+            _arrive();
+        }
+
+        template <std::size_t... Index>
+        void _complete(std::index_sequence<Index...>)
+        {
+            std::apply([this](auto&&... values){ _receiver.set_value(std::move(values)...); }, std::tuple_cat(std::move(*std::get<Index>(_values))...));
+        }
+
+        ReceiverT _receiver;
+        std::tuple<std::optional<_detail::values_of<SenderT>>...> _values;
+        std::atomic<int> _remaining = static_cast<int>(sizeof...(SenderT));
+        std::atomic<int> _outcome = succeeded;
+        spawn_result _error = spawn_result::success;
+
+        // last, as the children may complete into the rest as they start
+        _detail::when_all_children<when_all_operation, 0, SenderT...> _children;
+
+        template <typename, std::size_t> friend struct _detail::when_all_receiver;
+    };
+
+    template <typename... SenderT>
+    class when_all_sender
+    {
+    public:
+        using values = decltype(std::tuple_cat(std::declval<_detail::values_of<SenderT>>()...));
+
+        explicit when_all_sender(SenderT&&... senders) : _senders(std::move(senders)...) {}
+
+        template <typename ReceiverT>
+        when_all_operation<ReceiverT, SenderT...> connect(ReceiverT receiver) && { return _connect(std::move(receiver), std::index_sequence_for<SenderT...>()); }
+
+    private:
+        template <typename ReceiverT, std::size_t... Index>
+        when_all_operation<ReceiverT, SenderT...> _connect(ReceiverT&& receiver, std::index_sequence<Index...>)
+        {
+            return when_all_operation<ReceiverT, SenderT...>(std::move(receiver), std::move(std::get<Index>(_senders))...);
+        }
+
+        std::tuple<SenderT...> _senders;
+    };
+
+    template <typename... SenderT>
+    when_all_sender<std::decay_t<SenderT>...> when_all(SenderT&&... senders)
+    {
+        return when_all_sender<std::decay_t<SenderT>...>(std::move(senders)...);
+    }
+
+    // -- sync_wait: starts the sender and runs the queue's tasks until it
+    // completes. returns its values, or nothing if it failed or stopped.
+
+    namespace _detail
+    {
+
+        template <typename ValuesT>
+        struct sync_wait_state
+        {
+            std::optional<ValuesT> values;
+            // 1 once complete, 2 once the receiver is done touching us
+            std::atomic<int> stage = 0;
+            park waiting;
+        };
+
+        template <typename ValuesT>
+        struct sync_wait_receiver
+        {
+            sync_wait_state<ValuesT>* state = nullptr;
+
+            template <typename... ValueT> void set_value(ValueT&&... values)
+            {
+                state->values.emplace(std::forward<ValueT>(values)...);
+                _done();
+            }
+            void set_error(spawn_result) { _done(); }
+            void set_stopped() { _done(); }
+
+            void _done()
+            {
+                state->stage.store(1, std::memory_order_release);
+                state->waiting.unpark_all();
+                state->stage.store(2, std::memory_order_release);
+            }
+        };
+
+    }
+
+    template <typename SenderT>
+    std::optional<_detail::values_of<SenderT>> sync_wait(queue& helper, SenderT&& sender)
+    {
+        using values = _detail::values_of<SenderT>;
+
+        _detail::sync_wait_state<values> state;
+        auto operation = std::move(sender).connect(_detail::sync_wait_receiver<values>{&state});
+        operation.start();
+
+        auto complete = [&state]{ return state.stage.load(std::memory_order_acquire) != 0; };
+        _detail::sender_access::wait(helper, state.waiting, complete);
+
+        // the receiver may still be unparking us, and its state is ours
+        while (state.stage.load(std::memory_order_acquire) != 2)
+        {
+            std::this_thread::yield();
+        }
+        return std::move(state.values);
+    }
+
+}
+
+#endif // defined(_guard_JOBXX_SENDER_H)
@@ -0,0 +1,117 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_SHARED_QUEUE_H)
+#define _guard_JOBXX_SHARED_QUEUE_H
+#pragma once
+
+#if defined(__linux__)
+
+#include <cstddef>
+
+namespace jobxx
+{
+
+    enum class spawn_result;
+
+    // a task queue that several processes can feed and drain at once. the
+    // queue lives in a shared memory mapping: a fixed-size ring of tasks,
+    // plus a futex that idle workers sleep on. a task is the index of a
+    // function and a copy of a small payload of plain data; each process
+    // registers its own function at each index, since code addresses
+    // differ between processes.
+    //
+    // the mapping is shared by inheriting it across fork(), or by handing
+    // its file descriptor to another process (e.g. over a unix socket) and
+    // calling open() there.
+    class shared_queue
+    {
+    public:
+        using function = void(*)(void const* payload, std::size_t size);
+
+        static constexpr std::size_t max_payload = 48;
+        static constexpr int max_functions = 64;
+
+        shared_queue() = default;
+        ~shared_queue();
+
+        shared_queue(shared_queue const&) = delete;
+        shared_queue& operator=(shared_queue const&) = delete;
+
+        // sets up a new queue with room for capacity (a power of two)
+        // tasks, in the given file (e.g. from shm_open), or in a new
+        // memfd if fd is -1. returns false on failure. the queue takes
+        // ownership of the file descriptor if it succeeds.
+        bool create(std::size_t capacity, int fd = -1);
+        // maps a queue that another process created, taking ownership
+        // of the file descriptor if it succeeds. fails if the file is
+        // not a queue, or is smaller than its header says it should be.
+        bool open(int fd);
+
+        int fd() const { return _fd; }
+
+        bool register_function(int index, function fn);
+
+        // fails with spawn_result::queue_full if the ring is full, and with
+        // spawn_result::invalid_payload if the payload is too large. every
+        // process working the queue must have registered the function.
+        spawn_result spawn_task(int function, void const* payload, std::size_t size);
+
+        bool work_one();
+        void work_all();
+        void work_forever();
+
+        // the number of tasks this process took off the ring but could not
+        // run, because it had no function registered at their index.
+        std::size_t unhandled() const { return _unhandled; }
+
+        // closes the queue for every process using it.
+        void close();
+
+    private:
+        struct header;
+        struct slot;
+
+        bool _map(int fd, bool initialize, std::size_t capacity);
+        bool _ready() const;
+
+        int _fd = -1;
+        header* _header = nullptr;
+        slot* _slots = nullptr;
+        std::size_t _mapped_size = 0;
+        std::size_t _unhandled = 0;
+        function _functions[max_functions] = {};
+    };
+
+}
+
+#endif // defined(__linux__)
+
+#endif // defined(_guard_JOBXX_SHARED_QUEUE_H)
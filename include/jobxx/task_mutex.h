@@ -0,0 +1,77 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_TASK_MUTEX_H)
+#define _guard_JOBXX_TASK_MUTEX_H
+#pragma once
+
+#include "park.h"
+#include <atomic>
+
+namespace jobxx
+{
+
+    class queue;
+
+    // a mutex for use between tasks. a contended lock spins briefly and
+    // then, rather than putting the whole worker to sleep, keeps running
+    // the queue's other tasks until the mutex is released. unlock hands
+    // the mutex over by unparking one waiter.
+    //
+    // a task must not wait on a task_mutex while holding another one that
+    // the tasks it might run in the meantime could need.
+    class task_mutex
+    {
+    public:
+        task_mutex() = default;
+
+        task_mutex(task_mutex const&) = delete;
+        task_mutex& operator=(task_mutex const&) = delete;
+
+        bool try_lock();
+
+        // waits by parking the thread, as std::mutex would.
+        void lock();
+        // waits by running helper's tasks.
+        void lock(queue& helper);
+
+        void unlock();
+
+    private:
+        bool _spin();
+
+        std::atomic<bool> _locked = false;
+        std::atomic<int> _waiters = 0;
+        park _waiting;
+    };
+
+}
+
+#endif // defined(_guard_JOBXX_TASK_MUTEX_H)
@@ -0,0 +1,100 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#if !defined(_guard_JOBXX_URGENT_LANE_H)
+#define _guard_JOBXX_URGENT_LANE_H
+#pragma once
+
+#include "park.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace jobxx
+{
+
+    class queue;
+
+    struct urgent_lane_options
+    {
+        int workers = 1;
+
+        // nonzero runs the workers under SCHED_FIFO at this priority.
+        // that usually needs privileges the process may not have, in
+        // which case the workers are left as they are; see isolated().
+        int realtime_priority = 0;
+
+        // bit n allows the workers onto cpu n; 0 leaves them unpinned.
+        std::uint64_t cpu_mask = 0;
+
+        // once the lane is empty, a worker may run other tasks of the
+        // queue for this long before it waits on the lane alone again.
+        // a task can't be interrupted once it has started, so anything
+        // but zero lets a long task delay the lane; zero never does.
+        std::chrono::microseconds bulk_slice = std::chrono::microseconds(0);
+    };
+
+    // worker threads dedicated to a queue's urgent lane (see
+    // queue::spawn_urgent_task), so that urgent tasks are started right
+    // away even while every other worker is busy with a long task.
+    //
+    // destroying the lane stops its workers, but leaves the queue open;
+    // urgent tasks still waiting are then run by the other workers.
+    class urgent_lane
+    {
+    public:
+        explicit urgent_lane(queue& queue, urgent_lane_options const& options = urgent_lane_options());
+        ~urgent_lane();
+
+        urgent_lane(urgent_lane const&) = delete;
+        urgent_lane& operator=(urgent_lane const&) = delete;
+
+        int workers() const { return static_cast<int>(_workers.size()); }
+
+        // false if any worker could not be given the scheduling or
+        // cpus asked for. each worker applies them to itself before it
+        // runs any task, and the constructor waits for all of them.
+        bool isolated() const { return _isolated.load(std::memory_order_acquire); }
+
+    private:
+        queue& _queue;
+        std::chrono::microseconds const _bulk_slice;
+        std::atomic<bool> _stopping = false;
+        std::atomic<bool> _isolated = true;
+        std::atomic<int> _reported = 0;
+        park _started;
+        std::vector<std::thread> _workers;
+    };
+
+}
+
+#endif // defined(_guard_JOBXX_URGENT_LANE_H)
@@ -0,0 +1,95 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/_detail/arena.h"
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+jobxx::_detail::arena::~arena()
+{
+    auto const release = [](cursor& owner)
+    {
+        while (owner.chunks != nullptr)
+        {
+            chunk* const next = owner.chunks->next;
+            ::operator delete(owner.chunks);
+            owner.chunks = next;
+        }
+    };
+
+    for (cursor& owner : _workers)
+    {
+        release(owner);
+    }
+    release(_shared);
+}
+
+void* jobxx::_detail::arena::allocate(int worker, std::size_t size, std::size_t alignment)
+{
+    if (worker >= 0 && worker < queue_impl::max_workers)
+    {
+        return _allocate(_workers[worker], size, alignment);
+    }
+
+    std::lock_guard<spinlock> _(_shared_lock);
+    return _allocate(_shared, size, alignment);
+}
+
+void* jobxx::_detail::arena::_allocate(cursor& from, std::size_t size, std::size_t alignment)
+{
+    // alignment is required to be a power of two
+    auto const align_up = [alignment](char* pointer)
+    {
+        return reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(pointer) + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1));
+    };
+
+    char* result = align_up(from.next);
+    if (from.next == nullptr || result > from.end || static_cast<std::size_t>(from.end - result) < size)
+    {
+        // oversized requests get a chunk to themselves, but still
+        // become the current chunk; the remainder of the previous
+        // chunk is simply abandoned.
+        std::size_t const header = sizeof(chunk);
+        std::size_t const bytes = size + alignment + header > chunk_size ? size + alignment + header : chunk_size;
+
+        chunk* const fresh = new (::operator new(bytes)) chunk;
+        fresh->next = from.chunks;
+        from.chunks = fresh;
+        from.next = reinterpret_cast<char*>(fresh) + header;
+        from.end = reinterpret_cast<char*>(fresh) + bytes;
+
+        result = align_up(from.next);
+    }
+
+    from.next = result + size;
+    return result;
+}
@@ -0,0 +1,153 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+// compares std::mutex with jobxx::task_mutex under contention. half of
+// the tasks in a job need the same lock, the other half are independent.
+// a worker blocked on a std::mutex leaves the independent tasks waiting,
+// while one waiting on a task_mutex runs them. utilization is the share
+// of the workers' wall time spent doing task work.
+
+#include "jobxx/queue.h"
+#include "jobxx/job.h"
+#include "jobxx/task_mutex.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    constexpr int task_count = 4000;
+    constexpr auto critical_work = std::chrono::microseconds(20);
+    constexpr auto independent_work = std::chrono::microseconds(40);
+
+    // burn the CPU rather than sleep, as real work would
+    void spin_for(clock::duration duration)
+    {
+        auto const until = clock::now() + duration;
+        while (clock::now() < until)
+        {
+        }
+    }
+
+    struct result
+    {
+        double seconds = 0;
+        double utilization = 0;
+    };
+
+    template <typename LockFunctionT, typename UnlockFunctionT>
+    result run(int workers, LockFunctionT&& lock, UnlockFunctionT&& unlock)
+    {
+        jobxx::queue queue;
+        std::vector<std::thread> threads;
+        for (int index = 0; index < workers; ++index)
+        {
+            threads.emplace_back([&queue](){ queue.work_forever(); });
+        }
+
+        std::atomic<long long> busy_ns(0);
+        auto const start = clock::now();
+
+        auto contended = [&]()
+        {
+            lock(queue);
+            auto const begin = clock::now();
+            spin_for(critical_work);
+            busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+            unlock();
+        };
+
+        jobxx::job job = queue.create_job([&contended, &busy_ns](jobxx::context& ctx)
+        {
+            for (int index = 0; index < task_count; ++index)
+            {
+                if (index % 2 == 0)
+                {
+                    ctx.spawn_task([&contended](){ contended(); });
+                }
+                else
+                {
+                    ctx.spawn_task([&busy_ns]()
+                    {
+                        auto const begin = clock::now();
+                        spin_for(independent_work);
+                        busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+                    });
+                }
+            }
+        });
+
+        // the main thread only waits, so that it isn't counted as a worker
+        while (!job.complete())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto const elapsed = clock::now() - start;
+
+        queue.close();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        result outcome;
+        outcome.seconds = std::chrono::duration<double>(elapsed).count();
+        outcome.utilization = busy_ns.load() / (std::chrono::duration<double, std::nano>(elapsed).count() * workers);
+        return outcome;
+    }
+}
+
+int main()
+{
+    int const workers = std::thread::hardware_concurrency() > 1 ? static_cast<int>(std::thread::hardware_concurrency()) : 2;
+
+    std::mutex std_mutex;
+    result const blocking = run(workers,
+        [&std_mutex](jobxx::queue&){ std_mutex.lock(); },
+        [&std_mutex](){ std_mutex.unlock(); });
+
+    jobxx::task_mutex task_mutex;
+    result const helping = run(workers,
+        [&task_mutex](jobxx::queue& queue){ task_mutex.lock(queue); },
+        [&task_mutex](){ task_mutex.unlock(); });
+
+    std::printf("%d workers, %d tasks (half contending on one lock)\n", workers, task_count);
+    std::printf("%-18s %10s %12s\n", "", "seconds", "utilization");
+    std::printf("%-18s %10.3f %11.1f%%\n", "std::mutex", blocking.seconds, blocking.utilization * 100);
+    std::printf("%-18s %10.3f %11.1f%%\n", "jobxx::task_mutex", helping.seconds, helping.utilization * 100);
+    return 0;
+}
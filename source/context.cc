@@ -23,8 +23,79 @@
 
 #include "jobxx/context.h"
 #include "jobxx/_detail/queue_impl.h"
+#include "jobxx/_detail/job_impl.h"
+#include "jobxx/_detail/arena.h"
+#include <algorithm>
 
 auto jobxx::context::spawn_task(delegate&& work) -> spawn_result
 {
     return _queue.spawn_task(std::move(work), _job);
 }
+
+auto jobxx::context::spawn_task_blocking(delegate&& work) -> spawn_result
+{
+    return _queue.spawn_task_blocking(std::move(work), _job);
+}
+
+auto jobxx::context::spawn_task_on(int worker, delegate&& work) -> spawn_result
+{
+    return _queue.spawn_task_on(worker, std::move(work), _job);
+}
+
+auto jobxx::context::spawn_urgent_task(delegate&& work) -> spawn_result
+{
+    return _queue.spawn_urgent_task(std::move(work), _job);
+}
+
+int jobxx::context::worker_index() const
+{
+    _detail::worker_state const* const worker = _queue.local_worker();
+    return worker != nullptr ? worker->index : -1;
+}
+
+int jobxx::context::worker_count() const
+{
+    return std::min(_queue.next_worker.load(std::memory_order_relaxed), _detail::queue_impl::max_workers);
+}
+
+auto jobxx::context::current_job() const -> job
+{
+    // the job is kept alive by this very task, so taking another
+    // reference can't race with it being destroyed
+    if (_job != nullptr)
+    {
+        ++_job->refs;
+    }
+    return job(_job);
+}
+
+bool jobxx::context::cancelled() const
+{
+    return _job != nullptr && _job->cancelled.load(std::memory_order_relaxed);
+}
+
+void* jobxx::context::allocate(std::size_t size, std::size_t alignment)
+{
+    if (_job == nullptr)
+    {
+        return nullptr;
+    }
+
+    // the arena is created by whichever task first needs it
+    _detail::arena* scratch = _job->scratch.load(std::memory_order_acquire);
+    if (scratch == nullptr)
+    {
+        _detail::arena* const fresh = new _detail::arena;
+        if (_job->scratch.compare_exchange_strong(scratch, fresh, std::memory_order_acq_rel))
+        {
+            scratch = fresh;
+        }
+        else
+        {
+            delete fresh;
+        }
+    }
+
+    _detail::worker_state const* const worker = _queue.local_worker();
+    return scratch->allocate(worker != nullptr ? worker->index : -1, size, alignment);
+}
@@ -0,0 +1,173 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/elastic_pool.h"
+#include "jobxx/queue.h"
+
+namespace
+{
+    // the state of a blocking task, which is too big to fit in the
+    // delegate of the task running it.
+    struct blocking_task
+    {
+        jobxx::elastic_pool* pool = nullptr;
+        jobxx::delegate work;
+    };
+}
+
+jobxx::elastic_pool::elastic_pool(queue& queue, int parallelism, std::chrono::milliseconds idle_timeout) :
+    _queue(queue),
+    _parallelism(parallelism > 0 ? parallelism : std::thread::hardware_concurrency() > 0 ? static_cast<int>(std::thread::hardware_concurrency()) : 1),
+    _idle_timeout(idle_timeout)
+{
+    _workers.store(_parallelism, std::memory_order_relaxed);
+    for (int index = 0; index < _parallelism; ++index)
+    {
+        _core.emplace_back([this](){ _queue.work_forever(); });
+    }
+}
+
+jobxx::elastic_pool::~elastic_pool()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _stopping = true;
+    }
+
+    _queue.close();
+
+    for (auto& thread : _core)
+    {
+        thread.join();
+    }
+
+    // no spares can be started once we're stopping
+    for (auto& spare : _spares)
+    {
+        spare.thread.join();
+    }
+}
+
+jobxx::elastic_pool::blocking_region::blocking_region(elastic_pool& pool) : _pool(pool)
+{
+    _pool._blocked.fetch_add(1, std::memory_order_seq_cst);
+    _pool._queue._release_held_tasks();
+    _pool._compensate();
+}
+
+jobxx::elastic_pool::blocking_region::~blocking_region()
+{
+    // any spare now surplus will retire once it runs out of work
+    _pool._blocked.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+auto jobxx::elastic_pool::spawn_blocking(delegate&& work) -> spawn_result
+{
+    if (!work)
+    {
+        return _queue.spawn_task(std::move(work));
+    }
+
+    blocking_task* const state = new blocking_task{this, std::move(work)};
+    spawn_result const result = _queue.spawn_task([state](context& ctx)
+    {
+        {
+            blocking_region region(*state->pool);
+            state->work(ctx);
+        }
+        delete state;
+    });
+
+    if (result != spawn_result::success)
+    {
+        delete state;
+    }
+    return result;
+}
+
+void jobxx::elastic_pool::_compensate()
+{
+    // claim the new worker before starting it, so that concurrent
+    // blocking tasks don't both start one for the same shortfall.
+    int workers = _workers.load(std::memory_order_seq_cst);
+    do
+    {
+        if (workers - _blocked.load(std::memory_order_seq_cst) >= _parallelism)
+        {
+            return;
+        }
+    } while (!_workers.compare_exchange_weak(workers, workers + 1, std::memory_order_seq_cst));
+
+    std::lock_guard<std::mutex> _(_lock);
+
+    if (_stopping)
+    {
+        _workers.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // reap the spares that have retired since the last time
+    for (auto it = _spares.begin(); it != _spares.end();)
+    {
+        if (it->done.load(std::memory_order_acquire))
+        {
+            it->thread.join();
+            it = _spares.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    _spares.emplace_back();
+    spare& started = _spares.back();
+    started.thread = std::thread([this, &started]()
+    {
+        auto retire = [this]{ return _retire(); };
+        _queue._work_until_retired(_idle_timeout, retire);
+        started.done.store(true, std::memory_order_release);
+    });
+}
+
+bool jobxx::elastic_pool::_retire()
+{
+    int workers = _workers.load(std::memory_order_seq_cst);
+    do
+    {
+        if (workers - _blocked.load(std::memory_order_seq_cst) <= _parallelism)
+        {
+            return false;
+        }
+    } while (!_workers.compare_exchange_weak(workers, workers - 1, std::memory_order_seq_cst));
+
+    return true;
+}
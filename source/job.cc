@@ -31,6 +31,12 @@
 
 #include "jobxx/job.h"
 #include "jobxx/_detail/job_impl.h"
+#include "jobxx/_detail/arena.h"
+
+jobxx::_detail::job_impl::~job_impl()
+{
+    delete scratch.load(std::memory_order_acquire);
+}
 
 jobxx::job::~job()
 {
@@ -49,19 +55,41 @@ jobxx::job& jobxx::job::operator=(job&& rhs)
             delete _impl;
         }
 
+        // the reference moves along with the pointer
         _impl = rhs._impl;
         rhs._impl = nullptr;
-
-        if (_impl != nullptr)
-        {
-            ++_impl->refs;
-        }
     }
 
     return *this;
 }
 
+auto jobxx::job::stats() const -> job_stats
+{
+    job_stats stats;
+    if (_impl != nullptr && _impl->account != nullptr)
+    {
+        stats.jobs = 1;
+        stats.tasks = _impl->accounted_tasks.load(std::memory_order_relaxed);
+        stats.cpu_time = std::chrono::nanoseconds(_impl->cpu_ns.load(std::memory_order_relaxed));
+        stats.max_task_time = std::chrono::nanoseconds(_impl->max_task_ns.load(std::memory_order_relaxed));
+    }
+    return stats;
+}
+
 bool jobxx::job::complete() const
 {
     return _impl == nullptr || _impl->tasks == 0;
 }
+
+void jobxx::job::cancel()
+{
+    if (_impl != nullptr)
+    {
+        _impl->cancelled.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool jobxx::job::cancelled() const
+{
+    return _impl != nullptr && _impl->cancelled.load(std::memory_order_relaxed);
+}
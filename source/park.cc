@@ -29,69 +29,240 @@
 // Authors:
 //   Sean Middleditch <sean.middleditch@gmail.com>
 
+
 #include "jobxx/park.h"
+#include "jobxx/_detail/cache_line.h"
 #include <mutex>
 #include <condition_variable>
+#include <thread>
+#include <vector>
+
+// a park is a lock-free stack of the nodes of the threads parked on it.
+//
+// a thread doesn't unlink its nodes when it is unparked; doing so without
+// a lock would mean searching the stack. its nodes are instead left for
+// unparkers to pop and discard, and a thread parking on the same park
+// again simply revives its node where it lies. every park of a thread is
+// a new session, and a node only wakes the thread for the session it was
+// (last) linked for, so stale nodes are harmless.
+//
+// nodes are never freed, only recycled between threads, so that an
+// unparker may always read a node it found on the stack, even once it
+// has been popped by someone else.
 
-struct jobxx::park::thread_state
+namespace
 {
-    thread_state() = default;
+    // a thread's state packs its session and, within that session,
+    // whether it is idle, parked, or else which node unparked it.
+    constexpr int idle = -2;
+    constexpr int parked = -1;
 
-    thread_state(thread_state const&) = delete;
-    thread_state& operator=(thread_state const&) = delete;
+    constexpr std::uint64_t pack_state(std::uint32_t session, int state) { return (std::uint64_t(session) << 32) | std::uint32_t(state); }
+    constexpr std::uint32_t session_of(std::uint64_t packed) { return std::uint32_t(packed >> 32); }
+    constexpr int state_of(std::uint64_t packed) { return int(std::uint32_t(packed)); }
+
+    // a node is owned by its thread while free, by the park while listed,
+    // and by an unparker while busy. the nodes of an exited thread are
+    // dead, or orphaned if they were still listed at the time.
+    enum node_status : int { free_node, listed_node, busy_node, orphaned_node, dead_node };
+
+    // the stack's head is a node pointer, tagged in its upper bits.
+    constexpr unsigned tag_shift = sizeof(void*) == 8 ? 48 : 32;
+    constexpr std::uint64_t pointer_mask = (std::uint64_t(1) << tag_shift) - 1;
+}
+
+struct jobxx::_detail::parked_node
+{
+    // set by the thread, and read by unparkers once it is listed
+    parked_thread* thread = nullptr;
+    std::atomic<parked_node*> next = nullptr;
+    std::atomic<std::uint64_t> ticket = 0; // the session and the target's index
+    std::atomic<int> status = free_node;
+
+    // only used by the thread itself
+    jobxx::park* linked_to = nullptr;
+    std::uint32_t used_in = 0;
+};
+
+struct jobxx::_detail::parked_thread
+{
+    parked_thread() = default;
+    ~parked_thread();
+
+    parked_thread(parked_thread const&) = delete;
+    parked_thread& operator=(parked_thread const&) = delete;
+
+    // makes a node for the target listed on it for the current session.
+    void link(jobxx::park& target, int id, std::uint32_t session);
 
     // FIXME: we can make this more efficient on some platforms.
     // Linux, Win8+, etc. can sleep on the atomic's value/address (futexes).
     std::mutex _lock;
     std::condition_variable _cond;
-    std::atomic<int> _state = -2;
+    std::atomic<std::uint64_t> _state = pack_state(0, idle);
 
+    // every node this thread has, listed or not
+    std::vector<parked_node*> _nodes;
 };
 
-jobxx::park_result jobxx::park::_park(park* first, predicate first_pred, park* second, predicate second_pred)
+namespace
 {
-    thread_local thread_state local_thread;
-    thread_state& thread = local_thread; // can't capture thread_local variables in lambdas
+    // dead nodes, waiting to be reused by another thread.
+    struct node_pool
+    {
+        std::mutex lock;
+        std::vector<jobxx::_detail::parked_node*> nodes;
+    };
 
-    // we can't be parked again if we're already parked
-    int expected = -1;
-    if (!thread._state.compare_exchange_strong(expected, -1, std::memory_order_acquire))
+    node_pool& dead_nodes()
     {
-        return park_result::failure;
+        static node_pool* const pool = new node_pool; // never destroyed, as nodes never are
+        return *pool;
     }
 
-    // link into the park(s) that we want to be
-    // awoken by. note that our parked state is not
-    // guaranteed to still be true by the end of this
-    // process, so _wait must deal with that.
-    parked_node first_node;
-    first_node._id = 0;
-    first_node._thread = &thread;
-    first->_link(first_node);
+    std::uint64_t pack_head(jobxx::_detail::parked_node* node, std::uint64_t tag)
+    {
+        return reinterpret_cast<std::uintptr_t>(node) | (tag << tag_shift);
+    }
+
+    jobxx::_detail::parked_node* node_of(std::uint64_t head) { return reinterpret_cast<jobxx::_detail::parked_node*>(static_cast<std::uintptr_t>(head & pointer_mask)); }
+    std::uint64_t next_tag(std::uint64_t head) { return (head >> tag_shift) + 1; }
 
-    if (first_pred && first_pred())
+    void bury(jobxx::_detail::parked_node* node)
     {
-        first->_unlink(first_node);
-        return park_result::first;
+        node->status.store(dead_node, std::memory_order_relaxed);
+        node_pool& pool = dead_nodes();
+        std::lock_guard<std::mutex> _(pool.lock);
+        pool.nodes.push_back(node);
     }
+}
 
-    parked_node second_node;
-    if (second != nullptr)
+jobxx::_detail::parked_thread::~parked_thread()
+{
+    // a node still on some park's stack is left for its unparker to bury,
+    // and one an unparker is busy with may be using this very state.
+    for (parked_node* node : _nodes)
+    {
+        for (;;)
+        {
+            int status = node->status.load(std::memory_order_acquire);
+            if (status == free_node)
+            {
+                bury(node);
+                break;
+            }
+            if (status == listed_node && node->status.compare_exchange_strong(status, orphaned_node, std::memory_order_acq_rel))
+            {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+void jobxx::_detail::parked_thread::link(jobxx::park& target, int id, std::uint32_t session)
+{
+    std::uint64_t const ticket = pack_state(session, id);
+
+    parked_node* spare = nullptr;
+    for (parked_node* node : _nodes)
     {
-        first_node._id = 1;
-        second_node._thread = &thread;
-        second->_link(second_node);
+        if (node->used_in == session)
+        {
+            continue;
+        }
 
-        if (second_pred && second_pred())
+        // our node from an earlier park may still be on this park's
+        // stack, and if so needs only the new ticket. an unparker that
+        // pops it after we look reads the new ticket, and one that did
+        // so before is seen here.
+        if (node->linked_to == &target && node->status.load(std::memory_order_relaxed) == listed_node)
         {
-            // we may have been unparked by the prior condition if it triggered after its predicate but before now.
-            if (thread._state.compare_exchange_strong(expected, first_node._id, std::memory_order_seq_cst))
+            node->ticket.store(ticket, std::memory_order_seq_cst);
+            if (node->status.load(std::memory_order_seq_cst) == listed_node)
             {
-                first->_unlink(first_node);
-                second->_unlink(second_node);
-                return park_result::second;
+                node->used_in = session;
+                return;
             }
         }
+
+        if (spare == nullptr && node->status.load(std::memory_order_acquire) == free_node)
+        {
+            spare = node;
+        }
+    }
+
+    if (spare == nullptr)
+    {
+        {
+            node_pool& pool = dead_nodes();
+            std::lock_guard<std::mutex> _(pool.lock);
+            if (!pool.nodes.empty())
+            {
+                spare = pool.nodes.back();
+                pool.nodes.pop_back();
+            }
+        }
+        if (spare == nullptr)
+        {
+            spare = new parked_node;
+        }
+        spare->thread = this;
+        spare->status.store(free_node, std::memory_order_relaxed);
+        spare->linked_to = nullptr;
+        _nodes.push_back(spare);
+    }
+
+    spare->used_in = session;
+    spare->linked_to = &target;
+    spare->ticket.store(ticket, std::memory_order_relaxed);
+    spare->status.store(listed_node, std::memory_order_relaxed);
+    target._push(*spare);
+}
+
+jobxx::park_result jobxx::park::_park(park_target const* targets, std::size_t count, clock::time_point deadline)
+{
+    thread_local _detail::parked_thread local_thread;
+    thread_state& thread = local_thread; // can't capture thread_local variables in lambdas
+
+    // we can't be parked again if we're already parked; only this
+    // thread ever moves its state out of idle, so no race here.
+    std::uint64_t const current = thread._state.load(std::memory_order_relaxed);
+    if (state_of(current) != idle)
+    {
+        return park_result::failure;
+    }
+    std::uint32_t const session = session_of(current) + 1;
+    thread._state.store(pack_state(session, parked), std::memory_order_seq_cst);
+
+    // if another park unparked us in the meantime, it believes it awoke
+    // a thread to act on its event; we are leaving to act on a different
+    // event instead, so pass the wakeup along.
+    auto const pass_along = [targets](int old_state, int result)
+    {
+        if (old_state >= 0 && old_state != result)
+        {
+            targets[old_state].target->unpark_one();
+        }
+    };
+
+    // link into the park(s) that we want to be
+    // awoken by. note that our parked state is not
+    // guaranteed to still be true by the end of this
+    // process, so we must deal with that.
+    for (std::size_t index = 0; index != count; ++index)
+    {
+        thread.link(*targets[index].target, static_cast<int>(index), session);
+
+        predicate pred = targets[index].pred;
+        if (pred && pred())
+        {
+            // we may have been unparked after the predicate was
+            // satisfied; either way, we are no longer parked.
+            std::uint64_t const old_state = thread._state.exchange(pack_state(session, idle), std::memory_order_seq_cst);
+            pass_along(state_of(old_state), static_cast<int>(index));
+            return static_cast<park_result>(index);
+        }
     }
 
     // we check the predicate after parking to avoid a race condition.
@@ -103,46 +274,43 @@ jobxx::park_result jobxx::park::_park(park* first, predicate first_pred, park* s
     // itself were checked before parking, then there would be a gap
     // of time before checking the predicate and parking in which the
     // event could be triggered and effectively lost.
+    bool timed_out = false;
     {
         std::unique_lock<std::mutex> lock(thread._lock);
-        thread._cond.wait(lock, [&thread](){ return thread._state.load() == -1; });
+        auto const unparked = [&thread](){ return state_of(thread._state.load()) != parked; };
+        if (deadline == clock::time_point::max())
+        {
+            thread._cond.wait(lock, unparked);
+        }
+        else if (!thread._cond.wait_until(lock, deadline, unparked))
+        {
+            // the deadline passed, but an unpark may still race with us
+            // giving up; only report a timeout if we won that race, as
+            // otherwise the unparker believes it awoke this thread.
+            std::uint64_t expected = pack_state(session, parked);
+            timed_out = thread._state.compare_exchange_strong(expected, pack_state(session, idle), std::memory_order_seq_cst);
+        }
     }
 
     // determine whom unlocked us, and reset our state back to its default.
-    // note that the state will be either 0 or 1, which indicates which node
-    // unparked this thread; it maps to the park_result values.
-    int const old_state = thread._state.exchange(-2, std::memory_order::memory_order_seq_cst);
-
-    // unlink from both parks, because we very possibly were only
-    // unlinked by one of them, and we can't leave either with a
-    // dangling reference to a node.
-    first->_unlink(first_node);
-    if (second != nullptr)
-    {
-        second->_unlink(second_node);
-    }
+    // note that the state will be the id of the node that unparked this
+    // thread, which is the index of its target and maps to park_result.
+    // our nodes stay where they are, see above.
+    std::uint64_t const old_state = thread._state.exchange(pack_state(session, idle), std::memory_order_seq_cst);
 
-    return static_cast<park_result>(old_state);
+    return timed_out ? park_result::timeout : static_cast<park_result>(state_of(old_state));
 }
 
 bool jobxx::park::unpark_one()
 {
-    std::lock_guard<spinlock> _(_lock);
-
-    while (_parked._next != &_parked)
+    // keep popping until we awaken a thread; the
+    // stack holds the stale nodes of threads that
+    // have since left, or were unparked by another
+    // park, so we cannot assume that a node's
+    // presence means we unlocked its thread.
+    while (parked_node* const node = _pop())
     {
-        parked_node* const node = _parked._next;
-        _parked._next = _parked._next->_next;
-        _parked._next->_prev = &_parked;
-
-        node->_prev = node->_next = node;
-
-        // keep looping until we awaken a thread;
-        // a thread may already be unparked by another
-        // unpark operation even though it was still
-        // in our queue, so we cannot assume that its
-        // presence means we unlocked it.
-        if (_unpark(*node->_thread))
+        if (_unpark(*node))
         {
             return true;
         }
@@ -153,25 +321,40 @@ bool jobxx::park::unpark_one()
 
 void jobxx::park::unpark_all()
 {
-    std::lock_guard<spinlock> _(_lock);
+    // take the whole stack at once, and tell all
+    // currently-parked threads on it to awaken
+    std::uint64_t head = _head.load(std::memory_order_relaxed);
+    while (!_head.compare_exchange_weak(head, pack_head(nullptr, next_tag(head)), std::memory_order_acq_rel, std::memory_order_relaxed))
+    {
+        // head is reloaded by the failed exchange
+    }
 
-    // tell all currently-parked threads to awaken
-    parked_node* node = _parked._next;
-    while (node != &_parked)
+    parked_node* node = node_of(head);
+    while (node != nullptr)
     {
-        parked_node* const next = node->_next;
-        node->_prev = node->_next = node;
-        _unpark(*node->_thread);
+        // read before the node is released, and perhaps relinked
+        parked_node* const next = node->next.load(std::memory_order_relaxed);
+        _unpark(*node);
         node = next;
     }
-    _parked._prev = _parked._next = &_parked;
 }
 
-bool jobxx::park::_unpark(thread_state& thread)
+bool jobxx::park::_unpark(parked_node& node)
 {
-    // signal a thread to awaken _if_ it's currently parked.
-    int expected = -1;
-    bool const awoken = thread._state.compare_exchange_strong(expected, 0, std::memory_order_release);
+    // the node is ours now, and its thread can't go away while it is busy
+    int const status = node.status.exchange(busy_node, std::memory_order_seq_cst);
+    if (status == orphaned_node)
+    {
+        bury(&node);
+        return false;
+    }
+
+    // signal the thread to awaken _if_ it's still parked in the
+    // node's session, recording which of its nodes was responsible.
+    std::uint64_t const ticket = node.ticket.load(std::memory_order_seq_cst);
+    thread_state& thread = *node.thread;
+    std::uint64_t expected = pack_state(session_of(ticket), parked);
+    bool const awoken = thread._state.compare_exchange_strong(expected, ticket, std::memory_order_release);
     if (awoken)
     {
         // the lock is held to avoid a race; condition_variable
@@ -184,23 +367,35 @@ bool jobxx::park::_unpark(thread_state& thread)
         std::lock_guard<std::mutex> _(thread._lock);
         thread._cond.notify_one();
     }
+
+    node.status.store(free_node, std::memory_order_release);
     return awoken;
 }
 
-void jobxx::park::_link(parked_node& node)
+void jobxx::park::_push(parked_node& node)
 {
-    std::lock_guard<spinlock> _(_lock);
-
-    node._next = &_parked;
-    node._prev = _parked._prev;
-    node._prev->_next = &node;
-    _parked._prev = &node;
+    // acquire, so that a predicate checked after linking sees any event
+    // that an earlier unpark (which came before us on the stack) announced
+    std::uint64_t head = _head.load(std::memory_order_relaxed);
+    do
+    {
+        node.next.store(node_of(head), std::memory_order_relaxed);
+    } while (!_head.compare_exchange_weak(head, pack_head(&node, next_tag(head)), std::memory_order_acq_rel, std::memory_order_relaxed));
 }
 
-void jobxx::park::_unlink(parked_node& node)
+auto jobxx::park::_pop() -> parked_node*
 {
-    std::lock_guard<spinlock> _(_lock);
-
-    node._next->_prev = node._prev;
-    node._prev->_next = node._next;
+    std::uint64_t head = _head.load(std::memory_order_acquire);
+    for (;;)
+    {
+        // even an empty stack is written, so that a thread linking after
+        // us sees the event that we are unparking for, as it would if
+        // we had found its node instead.
+        parked_node* const node = node_of(head);
+        parked_node* const next = node != nullptr ? node->next.load(std::memory_order_relaxed) : nullptr;
+        if (_head.compare_exchange_weak(head, pack_head(next, next_tag(head)), std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return node;
+        }
+    }
 }
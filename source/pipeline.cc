@@ -0,0 +1,206 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/pipeline.h"
+#include "jobxx/queue.h"
+#include <algorithm>
+#include <mutex>
+
+struct jobxx::pipeline::item_state
+{
+    void* value = nullptr;
+    std::size_t sequence = 0;
+    std::size_t stage = 1;
+
+    // set when the item was handed a serial stage by its previous
+    // occupant, and so must run it without entering again.
+    bool entered = false;
+};
+
+void jobxx::pipeline::run(queue& queue, std::size_t max_tokens)
+{
+    if (_stages.empty() || max_tokens == 0)
+    {
+        return;
+    }
+
+    _tokens = max_tokens;
+    _input_done = false;
+    _input_scheduled = false;
+    _input_sequence = 0;
+    for (auto& stage : _stages)
+    {
+        stage->busy = false;
+        stage->next_sequence = 0;
+    }
+
+    // every item in flight is always held by some task of the job (an
+    // item waiting on a serial stage is handed on by the task leaving
+    // that stage) so the job completes exactly when the stream is done.
+    job const stream = queue.create_job([this](context& ctx){ _schedule_input(ctx); });
+    queue.wait_job_actively(stream);
+}
+
+void jobxx::pipeline::_schedule_input(context& ctx)
+{
+    {
+        std::lock_guard<spinlock> _(_input_lock);
+        if (_input_done || _input_scheduled || _tokens.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+        _input_scheduled = true;
+        --_tokens;
+    }
+
+    // the input can't be dropped, which would lose its token for good;
+    // on a full queue, the spawn helps drain it until there is room.
+    if (ctx.spawn_task_blocking([this](context& ctx){ _input(ctx); }) != spawn_result::success)
+    {
+        _input(ctx);
+    }
+}
+
+void jobxx::pipeline::_input(context& ctx)
+{
+    // only one input task is ever scheduled at a time
+    void* const value = (*_stages.front()->filter)(nullptr);
+
+    if (value == nullptr)
+    {
+        {
+            std::lock_guard<spinlock> _(_input_lock);
+            _input_done = true;
+            _input_scheduled = false;
+        }
+        ++_tokens;
+        return;
+    }
+
+    item_state* const item = new item_state;
+    item->value = value;
+    item->sequence = _input_sequence++;
+
+    {
+        std::lock_guard<spinlock> _(_input_lock);
+        _input_scheduled = false;
+    }
+
+    // read ahead while this item goes through the later stages
+    _schedule_input(ctx);
+    _process(ctx, item);
+}
+
+void jobxx::pipeline::_process(context& ctx, item_state* item)
+{
+    for (; item->stage != _stages.size(); ++item->stage)
+    {
+        stage& current = *_stages[item->stage];
+        bool const serial = current.mode != stage_mode::parallel;
+
+        if (serial && !item->entered && !_enter(current, item))
+        {
+            // the stage is busy; whoever leaves it will resume the item
+            return;
+        }
+        item->entered = false;
+
+        // dropped items still take their turn in serial stages, so that
+        // the in-order stages after them don't wait for them forever.
+        if (item->value != nullptr)
+        {
+            item->value = (*current.filter)(item->value);
+        }
+
+        if (serial)
+        {
+            // the item we hand the stage to is spawned, which puts it in
+            // this worker's LIFO slot, or on the shared queue while other
+            // workers are idle; either way an idle worker can take it up
+            // while this thread keeps going with its own item while it's
+            // hot. on a busy queue it simply runs here next. as with the
+            // input, it can't be dropped, or the stage would stall.
+            item_state* const next = _leave(current);
+            if (next != nullptr)
+            {
+                next->entered = true;
+                if (ctx.spawn_task_blocking([this, next](context& ctx){ _process(ctx, next); }) != spawn_result::success)
+                {
+                    _process(ctx, next);
+                }
+            }
+        }
+    }
+
+    delete item;
+    ++_tokens;
+    _schedule_input(ctx);
+}
+
+bool jobxx::pipeline::_enter(stage& stage, item_state* item)
+{
+    std::lock_guard<spinlock> _(stage.lock);
+
+    if (!stage.busy && (stage.mode != stage_mode::serial_in_order || item->sequence == stage.next_sequence))
+    {
+        stage.busy = true;
+        return true;
+    }
+
+    stage.waiting.push_back(item);
+    return false;
+}
+
+auto jobxx::pipeline::_leave(stage& stage) -> item_state*
+{
+    std::lock_guard<spinlock> _(stage.lock);
+
+    item_state* next = nullptr;
+    if (stage.mode == stage_mode::serial_in_order)
+    {
+        ++stage.next_sequence;
+        auto const found = std::find_if(stage.waiting.begin(), stage.waiting.end(), [&stage](item_state* waiting){ return waiting->sequence == stage.next_sequence; });
+        if (found != stage.waiting.end())
+        {
+            next = *found;
+            stage.waiting.erase(found);
+        }
+    }
+    else if (!stage.waiting.empty())
+    {
+        next = stage.waiting.front();
+        stage.waiting.pop_front();
+    }
+
+    // the stage stays busy when it's handed straight to the next item
+    stage.busy = next != nullptr;
+    return next;
+}
@@ -34,30 +34,224 @@
 #include "jobxx/_detail/job_impl.h"
 #include "jobxx/_detail/queue_impl.h"
 #include "jobxx/_detail/task.h"
+#include "jobxx/_detail/arena.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#   include <time.h>
+#endif
+
+static_assert(jobxx::queue::max_workers == jobxx::_detail::queue_impl::max_workers, "worker limits must agree");
+
+namespace
+{
+    thread_local jobxx::_detail::worker_state* current_worker = nullptr;
+
+    // the time the calling thread has spent running accounted tasks from
+    // within other tasks, e.g. while one waits on a job. a task takes off
+    // what grew here while it ran, as it was charged to the nested tasks.
+    thread_local std::uint64_t nested_task_ns = 0;
+
+    // time the calling thread has spent on the CPU, for job accounting.
+    std::uint64_t thread_cpu_ns()
+    {
+#if defined(_WIN32)
+        // kernel and user times, in 100ns ticks
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        std::uint64_t const ticks =
+            ((static_cast<std::uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) +
+            ((static_cast<std::uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+        return ticks * 100u;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+        timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return static_cast<std::uint64_t>(now.tv_sec) * 1000000000u + static_cast<std::uint64_t>(now.tv_nsec);
+#else
+        // FIXME: no per-thread CPU clock here, so fall back to wall time
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // hints that a task is about to be run, so that its delegate is
+    // in cache by the time the current one is done.
+    void prefetch(jobxx::_detail::task const* item)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(item);
+#else
+        (void)item;
+#endif
+    }
+
+    void add_max(std::atomic<std::uint64_t>& max, std::uint64_t value)
+    {
+        std::uint64_t current = max.load(std::memory_order_relaxed);
+        while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+            // current is reloaded by the failed exchange
+        }
+    }
+
+    // adds to a named job's figures, and to its name's totals; done
+    // before the tasks are retired, so both are complete with the job.
+    void charge(jobxx::_detail::job_impl& job, std::uint64_t tasks, std::uint64_t cpu_ns, std::uint64_t max_task_ns)
+    {
+        job.accounted_tasks.fetch_add(tasks, std::memory_order_relaxed);
+        job.cpu_ns.fetch_add(cpu_ns, std::memory_order_relaxed);
+        add_max(job.max_task_ns, max_task_ns);
+
+        jobxx::_detail::job_account& account = *job.account;
+        account.tasks.fetch_add(tasks, std::memory_order_relaxed);
+        account.cpu_ns.fetch_add(cpu_ns, std::memory_order_relaxed);
+        add_max(account.max_task_ns, max_task_ns);
+    }
+
+    // establishes the calling thread as a worker of the queue for the
+    // duration of a work call. nested calls on the same queue share the
+    // outermost state; a task left in the LIFO slot when the outermost
+    // call returns is handed to the shared queue so it cannot be stranded.
+    // the queue's creating thread is always worker 0, and other threads
+    // only get an id (and a mailbox) when registering via work_forever or
+    // as a spare, which they give back on leaving, to be reused.
+    class worker_scope
+    {
+    public:
+        explicit worker_scope(jobxx::_detail::queue_impl& queue, bool register_worker = false) : _previous(current_worker)
+        {
+            if (_previous == nullptr || _previous->queue != &queue)
+            {
+                _state.queue = &queue;
+                if (std::this_thread::get_id() == queue.owner)
+                {
+                    _state.index = 0;
+                }
+                else if (register_worker)
+                {
+                    _state.index = queue.acquire_worker();
+                    _registered = _state.index >= 0;
+                }
+                if (_state.index >= 0)
+                {
+                    _state.inbox = &queue.mailboxes[_state.index];
+                    if (_registered)
+                    {
+                        _state.inbox->open.store(true, std::memory_order_seq_cst);
+                    }
+                }
+                current_worker = &_state;
+            }
+        }
+
+        jobxx::_detail::mailbox* inbox() const { return current_worker->inbox; }
+
+        ~worker_scope()
+        {
+            if (current_worker == &_state)
+            {
+                _state.queue->release_held_tasks(_state);
+
+                // nobody is left to run tasks sent to a worker that has
+                // gone, so they're shared instead; see spawn_task_on.
+                if (_registered)
+                {
+                    _state.inbox->open.store(false, std::memory_order_seq_cst);
+                    _state.queue->drain_mailbox(*_state.inbox);
+                    _state.queue->release_worker(_state.index);
+                }
+                current_worker = _previous;
+            }
+            else if (current_worker != nullptr && current_worker->task_depth != 0)
+            {
+                // a wait or run loop is returning to the task that called
+                // it, which may run for a good while yet; the completions
+                // of other jobs it ran meanwhile mustn't wait on that.
+                current_worker->queue->flush_retired(*current_worker);
+            }
+        }
+
+        worker_scope(worker_scope const&) = delete;
+        worker_scope& operator=(worker_scope const&) = delete;
+
+    private:
+        jobxx::_detail::worker_state* _previous = nullptr;
+        jobxx::_detail::worker_state _state;
+        bool _registered = false;
+    };
+}
 
 jobxx::queue::queue() : _impl(new _detail::queue_impl) {}
 
+jobxx::queue::queue(queue_capacity const& capacity) : queue()
+{
+    _impl->max_tasks = capacity.max_tasks;
+    _impl->high_watermark = capacity.high_watermark;
+    _impl->low_watermark = capacity.low_watermark;
+    _impl->on_watermark = capacity.on_watermark;
+    _impl->watermark_data = capacity.user_data;
+    _impl->inline_threshold = capacity.inline_threshold;
+}
+
 jobxx::queue::~queue()
 {
     close();
+
+    // tasks may still be waiting for workers that have gone away;
+    // run them here rather than leak them (and their jobs).
+    for (int index = 0; index != _detail::queue_impl::max_workers; ++index)
+    {
+        _detail::task* item = nullptr;
+        while (_impl->mailboxes[index].tasks.pop_front(item))
+        {
+            _impl->execute(item);
+        }
+    }
+    _detail::task* item = nullptr;
+    while (_impl->urgent_tasks.pop_front(item))
+    {
+        _impl->execute(item);
+    }
+
     delete _impl;
 }
 
 void jobxx::queue::wait_job_actively(job const& awaited)
 {
-    if (awaited.complete())
-    {
-        return;
-    }
+    _wait_job(awaited, clock::time_point::max());
+}
+
+auto jobxx::queue::_wait_job(job const& awaited, clock::time_point deadline) -> wait_result
+{
+    worker_scope scope(*_impl);
+    bool const timed = deadline != clock::time_point::max();
 
     while (!awaited.complete())
     {
+        if (timed && clock::now() >= deadline)
+        {
+            return wait_result::timeout;
+        }
+
         work_one();
 
         _detail::task* item = nullptr;
-        park_result const result = park::park_until(
-            _impl->waiting, [&awaited]{ return awaited.complete(); },
-            awaited._impl->waiting, [this, &item]{ return (item = _impl->pull_task()) != nullptr; });
+        auto job_complete = [&awaited]{ return awaited.complete(); };
+        auto task_available = [this, &item]{ return (item = _impl->pull_task()) != nullptr; };
+
+        // we may be woken by the job, by the shared queue, or by
+        // a task targeted at this thread.
+        _detail::mailbox* const inbox = scope.inbox();
+        park_target const targets[] = {{&awaited._impl->waiting, job_complete}, {&_impl->waiting, task_available}, {inbox != nullptr ? &inbox->waiting : nullptr, task_available}};
+        std::size_t const count = inbox != nullptr ? 3 : 2;
+        park_result const result = timed ?
+            park::park_until_any_for(targets, count, deadline - clock::now()) :
+            park::park_until_any(targets, count);
 
         // if we were unparked by the task queue, that means that there is work
         // available. we will only have acquired the task already if it was ready
@@ -67,7 +261,7 @@ void jobxx::queue::wait_job_actively(job const& awaited)
         // thread in order to ensure that the work gets done in a timely manner.
         // FIXME: this addresses a race condition, but I'm really not happy with the
         // general design or interface here.
-        if (result == park_result::second && item == nullptr)
+        if (result >= park_result::second && item == nullptr)
         {
             item = _impl->pull_task();
         }
@@ -80,10 +274,132 @@ void jobxx::queue::wait_job_actively(job const& awaited)
             _impl->execute(item);
         }
     }
+
+    return wait_result::complete;
+}
+
+void jobxx::queue::_wait_until(park& target, predicate ready)
+{
+    _impl->wait_until(target, ready);
+}
+
+std::size_t jobxx::queue::wait_any(job const* const* jobs, std::size_t count)
+{
+    return _wait_jobs(jobs, count, false);
+}
+
+void jobxx::queue::wait_all(job const* const* jobs, std::size_t count)
+{
+    _wait_jobs(jobs, count, true);
+}
+
+std::size_t jobxx::queue::_wait_jobs(job const* const* jobs, std::size_t count, bool all)
+{
+    worker_scope scope(*_impl);
+
+    // when waiting on all of them, whichever job wakes the thread
+    // checks the lot, so it parks just once for the whole set rather
+    // than once for each job in turn.
+    struct job_complete
+    {
+        job const* const* jobs;
+        std::size_t count;
+        std::size_t index;
+        bool all;
+        bool operator()()
+        {
+            if (!all)
+            {
+                return jobs[index]->complete();
+            }
+            for (std::size_t other = 0; other != count; ++other)
+            {
+                if (!jobs[other]->complete())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // the thread is parked on every incomplete job plus the task queue
+    // and its own mailbox, so small sets of jobs are kept on the stack.
+    constexpr std::size_t inline_jobs = 6;
+    job_complete local_preds[inline_jobs];
+    park_target local_targets[inline_jobs + 2];
+    std::unique_ptr<job_complete[]> heap_preds;
+    std::unique_ptr<park_target[]> heap_targets;
+    job_complete* preds = local_preds;
+    park_target* targets = local_targets;
+    if (count > inline_jobs)
+    {
+        heap_preds.reset(new job_complete[count]);
+        heap_targets.reset(new park_target[count + 2]);
+        preds = heap_preds.get();
+        targets = heap_targets.get();
+    }
+
+    for (;;)
+    {
+        // only the jobs yet to complete are parked on.
+        std::size_t parked = 0;
+        for (std::size_t index = 0; index != count; ++index)
+        {
+            if (!jobs[index]->complete())
+            {
+                preds[parked] = job_complete{jobs, count, index, all};
+                targets[parked].target = &jobs[index]->_impl->waiting;
+                targets[parked].pred = preds[parked];
+                ++parked;
+            }
+            else if (!all)
+            {
+                return index;
+            }
+        }
+        if (parked == 0)
+        {
+            return count;
+        }
+
+        if (work_one())
+        {
+            continue;
+        }
+
+        _detail::task* item = nullptr;
+        auto task_available = [this, &item]{ return (item = _impl->pull_task()) != nullptr; };
+        targets[parked].target = &_impl->waiting;
+        targets[parked].pred = task_available;
+
+        _detail::mailbox* const inbox = scope.inbox();
+        if (inbox != nullptr)
+        {
+            targets[parked + 1].target = &inbox->waiting;
+            targets[parked + 1].pred = task_available;
+        }
+
+        park_result const result = park::park_until_any(targets, parked + (inbox != nullptr ? 2 : 1));
+
+        // as in _wait_job, being unparked by the task queue obliges
+        // us to act on the task it announced.
+        if (result >= static_cast<park_result>(parked) && item == nullptr)
+        {
+            item = _impl->pull_task();
+        }
+
+        if (item != nullptr)
+        {
+            _impl->execute(item);
+        }
+    }
 }
 
 bool jobxx::queue::work_one()
 {
+    worker_scope scope(*_impl);
+
     _detail::task* item = _impl->pull_task();
     if (item != nullptr)
     {
@@ -98,6 +414,8 @@ bool jobxx::queue::work_one()
 
 void jobxx::queue::work_all()
 {
+    worker_scope scope(*_impl);
+
     while (work_one())
     {
         // keep looping while there's work
@@ -106,15 +424,60 @@ void jobxx::queue::work_all()
 
 void jobxx::queue::work_forever()
 {
+    worker_scope scope(*_impl, /*register_worker=*/true);
+    _detail::mailbox* const inbox = scope.inbox();
+
     while (!_impl->closed.load(std::memory_order_relaxed))
     {
         work_all();
 
+        // going idle must be visible before we look for work one last
+        // time, so that a worker setting work aside either sees us idle
+        // and shares it, or we find it; see schedule.
+        _impl->idle_workers.fetch_add(1, std::memory_order_seq_cst);
+
+        // one idle worker at a time sleeps in the poller, if there is
+        // one, dispatching its events; the rest park as usual.
+        bool const has_poller = _impl->io_poller.load(std::memory_order_seq_cst) != nullptr;
+        if (has_poller)
+        {
+            auto work_ready = [this, inbox]
+            {
+                return _impl->closed.load(std::memory_order_relaxed) || !_impl->tasks.maybe_empty() ||
+                    _impl->urgent_pending.load(std::memory_order_acquire) != 0 || _impl->stealable() ||
+                    (inbox != nullptr && inbox->pending.load(std::memory_order_acquire) != 0);
+            };
+
+            bool polled = false;
+            if (_detail::poller* const io = _impl->acquire_poller())
+            {
+                polled = io->poll(work_ready);
+                _impl->release_poller();
+            }
+            if (polled)
+            {
+                _impl->idle_workers.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+
         _detail::task* item = nullptr;
-        _impl->waiting.park_until([this, &item]
+        auto task_available = [this, &item, has_poller]
         {
-            return _impl->closed.load(std::memory_order_relaxed) || (item = _impl->pull_task()) != nullptr;
-        });
+            // a poller installed while we weren't looking needs a worker to
+            // sleep in it, and nothing else would ever wake us up for it.
+            return _impl->closed.load(std::memory_order_relaxed) || (item = _impl->pull_task()) != nullptr ||
+                (!has_poller && _impl->io_poller.load(std::memory_order_seq_cst) != nullptr);
+        };
+        if (inbox != nullptr)
+        {
+            park::park_until(_impl->waiting, task_available, inbox->waiting, task_available);
+        }
+        else
+        {
+            _impl->waiting.park_until(task_available);
+        }
+        _impl->idle_workers.fetch_sub(1, std::memory_order_relaxed);
 
         // we don't want to execute work inside the
         // parkable condition, but we have to act
@@ -124,6 +487,125 @@ void jobxx::queue::work_forever()
             _impl->execute(item);
         }
     }
+
+    // don't leave behind any tasks that only we may run
+    work_all();
+}
+
+void jobxx::queue::_work_until_retired(clock::duration idle_timeout, predicate retire)
+{
+    // spares come and go, so the id they take is soon reused by the next.
+    worker_scope scope(*_impl, /*register_worker=*/true);
+    _detail::mailbox* const inbox = scope.inbox();
+
+    while (!_impl->closed.load(std::memory_order_relaxed))
+    {
+        work_all();
+
+        _detail::task* item = nullptr;
+        auto task_available = [this, &item]
+        {
+            return _impl->closed.load(std::memory_order_relaxed) || (item = _impl->pull_task()) != nullptr;
+        };
+        park_target const targets[] = {{&_impl->waiting, task_available}, {inbox != nullptr ? &inbox->waiting : nullptr, task_available}};
+        _impl->idle_workers.fetch_add(1, std::memory_order_seq_cst);
+        park_result const result = park::park_until_any_for(targets, inbox != nullptr ? 2 : 1, idle_timeout);
+        _impl->idle_workers.fetch_sub(1, std::memory_order_relaxed);
+        if (result == park_result::timeout)
+        {
+            if (retire())
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (item == nullptr)
+        {
+            item = _impl->pull_task();
+        }
+        if (item != nullptr)
+        {
+            _impl->execute(item);
+        }
+    }
+
+    work_all();
+}
+
+void jobxx::queue::_work_urgent(clock::duration bulk_slice, predicate stop)
+{
+    // no worker_scope: an urgent worker has no LIFO slot or batch for
+    // bulk tasks to sit in while the lane waits, and what its tasks
+    // spawn goes straight to the shared queue.
+    while (!_impl->closed.load(std::memory_order_relaxed) && !stop())
+    {
+        _detail::task* item = _impl->pull_urgent();
+        if (item != nullptr)
+        {
+            _impl->execute(item);
+            continue;
+        }
+
+        // with the lane empty, help with other work for a while. a task
+        // that has started can't be interrupted, so the slice bounds how
+        // long we keep taking them, not how long the last one runs;
+        // pull_task looks at the lane first, so urgent tasks that arrive
+        // meanwhile are still run first.
+        if (bulk_slice > clock::duration::zero())
+        {
+            clock::time_point const deadline = clock::now() + bulk_slice;
+            while ((item = _impl->pull_task()) != nullptr)
+            {
+                _impl->execute(item);
+                item = nullptr;
+                if (clock::now() >= deadline)
+                {
+                    break;
+                }
+            }
+        }
+
+        _impl->urgent_waiting.park_until([this, &item, &stop]
+        {
+            return _impl->closed.load(std::memory_order_relaxed) || stop() || (item = _impl->pull_urgent()) != nullptr;
+        });
+
+        if (item != nullptr)
+        {
+            _impl->execute(item);
+        }
+    }
+}
+
+void jobxx::queue::_wake_urgent()
+{
+    _impl->urgent_waiting.unpark_all();
+}
+
+auto jobxx::queue::stats_for(char const* name) -> job_stats
+{
+    std::lock_guard<std::mutex> _(_impl->accounts_lock);
+
+    job_stats stats;
+    auto const found = _impl->accounts.find(name);
+    if (found != _impl->accounts.end())
+    {
+        _detail::job_account const& account = found->second;
+        stats.jobs = account.jobs.load(std::memory_order_relaxed);
+        stats.tasks = account.tasks.load(std::memory_order_relaxed);
+        stats.cpu_time = std::chrono::nanoseconds(account.cpu_ns.load(std::memory_order_relaxed));
+        stats.max_task_time = std::chrono::nanoseconds(account.max_task_ns.load(std::memory_order_relaxed));
+    }
+    return stats;
+}
+
+void jobxx::queue::_release_held_tasks()
+{
+    if (_detail::worker_state* const worker = _impl->local_worker())
+    {
+        _impl->release_held_tasks(*worker);
+    }
 }
 
 void jobxx::queue::close()
@@ -137,6 +619,7 @@ void jobxx::queue::close()
     // prevents reparking).
     _impl->closed.store(true);
     _impl->waiting.unpark_all();
+    _impl->wake_poller();
 
     // actually finish any work remaining, knowing
     // that no new work can be added to the queue
@@ -144,9 +627,21 @@ void jobxx::queue::close()
     work_all();
 }
 
-jobxx::_detail::job_impl* jobxx::queue::_create_job()
+jobxx::_detail::job_impl* jobxx::queue::_create_job(char const* name)
+{
+    _detail::job_impl* const job_impl = new _detail::job_impl;
+    if (name != nullptr)
+    {
+        job_impl->account = _impl->find_account(name);
+        job_impl->account->jobs.fetch_add(1, std::memory_order_relaxed);
+    }
+    _impl->add_task(job_impl);
+    return job_impl;
+}
+
+void jobxx::queue::_submit_job(_detail::job_impl* job_impl)
 {
-    return new _detail::job_impl;
+    _impl->retire_tasks(job_impl, 1);
 }
 
 auto jobxx::queue::spawn_task(delegate&& work) -> spawn_result
@@ -154,7 +649,22 @@ auto jobxx::queue::spawn_task(delegate&& work) -> spawn_result
     return _impl->spawn_task(std::move(work), nullptr);
 }
 
-auto jobxx::_detail::queue_impl::spawn_task(delegate work, _detail::job_impl* parent) -> spawn_result
+auto jobxx::queue::spawn_task_blocking(delegate&& work) -> spawn_result
+{
+    return _impl->spawn_task_blocking(std::move(work), nullptr);
+}
+
+auto jobxx::queue::spawn_task_on(int worker, delegate&& work) -> spawn_result
+{
+    return _impl->spawn_task_on(worker, std::move(work), nullptr);
+}
+
+auto jobxx::queue::spawn_urgent_task(delegate&& work) -> spawn_result
+{
+    return _impl->spawn_urgent_task(std::move(work), nullptr);
+}
+
+auto jobxx::_detail::queue_impl::spawn_task(delegate&& work, _detail::job_impl* parent) -> spawn_result
 {
     // task with no work is not allowed/useful
     if (!work)
@@ -165,65 +675,910 @@ auto jobxx::_detail::queue_impl::spawn_task(delegate work, _detail::job_impl* pa
     // we can't spawn tasks on closed queue
     if (closed.load(std::memory_order_acquire))
     {
-        return spawn_result::queue_full;
+        return spawn_result::queue_closed;
     }
 
-    if (parent != nullptr)
+    // a task that would only wait behind many others is cheaper to run
+    // now; it still goes through execute, to be counted and cancelled
+    // like any other task of its job.
+    worker_state* const worker = local_worker();
+    if (should_inline(worker))
     {
-        // increment the number of pending tasks
-        // and if this is the first task, add a
-        // reference so the job isn't deleted
-        // before the task completes. we only do
-        // this count on the first/last task to
-        // avoid excessive reference counting.
-        if (0 == parent->tasks++)
+        if (parent != nullptr)
         {
-            ++parent->refs;
+            add_task(parent);
         }
+
+        _detail::task item{std::move(work), parent, /*owned=*/false};
+        ++worker->inline_depth;
+        execute(&item);
+        --worker->inline_depth;
+        return spawn_result::success;
     }
 
-    _detail::task* item = new _detail::task{std::move(work), parent};
-    tasks.push_back(item);
-    waiting.unpark_one();
+    if (!reserve_slot())
+    {
+        return spawn_result::queue_full;
+    }
+
+    if (parent != nullptr)
+    {
+        add_task(parent);
+    }
 
+    schedule(new _detail::task{std::move(work), parent});
     return spawn_result::success;
 }
 
-jobxx::_detail::task* jobxx::_detail::queue_impl::pull_task()
+bool jobxx::_detail::queue_impl::should_inline(worker_state const* worker) const
 {
-    jobxx::_detail::task* item = nullptr;
-    tasks.pop_front(item); // on failure, item is left unmodified, e.g. nullptr
-    return item;
+    if (inline_threshold == 0 || worker == nullptr || worker->inline_depth >= max_inline_depth)
+    {
+        return false;
+    }
+
+    return queued.load(std::memory_order_relaxed) >= inline_threshold ||
+        (worker->inbox != nullptr && worker->inbox->next_task.load(std::memory_order_relaxed) != nullptr &&
+            idle_workers.load(std::memory_order_relaxed) == 0);
 }
 
-void jobxx::_detail::queue_impl::execute(_detail::task* item)
+auto jobxx::_detail::queue_impl::spawn_node(_detail::task* item) -> spawn_result
 {
-    if (item->work)
+    if (closed.load(std::memory_order_acquire))
     {
-        context ctx(*this, item->parent);
-        item->work(ctx);
+        return spawn_result::queue_closed;
+    }
+
+    if (!reserve_slot())
+    {
+        return spawn_result::queue_full;
     }
 
     if (item->parent != nullptr)
     {
-        // decrement the number of outstanding
-        // tasks. if this is the last task that
-        // was pending, also remove the reference
-        // count we added when the first task was
-        // added, since there are no longer any
-        // tasks referencing the job.
-        if (0 == --item->parent->tasks)
-        {
-            // awaken any parked threads awaiting the job
-            item->parent->waiting.unpark_all();
+        add_task(item->parent);
+    }
+
+    schedule(item);
+    return spawn_result::success;
+}
+
+void jobxx::_detail::queue_impl::schedule(_detail::task* item)
+{
+    // a task spawned by a worker displaces that worker's LIFO slot; the
+    // worker is already awake and will run the new task as soon as its
+    // current one finishes, so only the displaced task (if any) needs to
+    // be shared and another worker woken.
+    worker_state* const worker = local_worker();
+    mailbox* const inbox = worker != nullptr ? worker->inbox : nullptr;
+    if (inbox != nullptr)
+    {
+        item = inbox->next_task.exchange(item, std::memory_order_seq_cst);
 
-            if (0 == --item->parent->refs)
+        // but idle workers only look in the slot as they go idle, and the
+        // spawning task may yet block waiting on the new one, so while
+        // any are idle it's shared as well. one that went idle after we
+        // looked will find it in the slot instead.
+        if (idle_workers.load(std::memory_order_seq_cst) != 0)
+        {
+            if (item != nullptr)
             {
-                delete item->parent;
+                push_task(item);
             }
+            item = inbox->next_task.exchange(nullptr, std::memory_order_acquire);
         }
     }
 
-    // the task is no longer needed
-    delete item;
+    if (item != nullptr)
+    {
+        push_task(item);
+    }
+}
+
+auto jobxx::_detail::queue_impl::spawn_task_blocking(delegate&& work, _detail::job_impl* parent) -> spawn_result
+{
+    for (;;)
+    {
+        spawn_result const result = spawn_task(std::move(work), parent);
+        if (result != spawn_result::queue_full)
+        {
+            return result;
+        }
+
+        // rather than sleep while the queue is full, help drain it; we
+        // only park if every queued task has already been taken by
+        // other threads, in which case one of them will soon make room.
+        _detail::task* item = pull_task();
+        if (item == nullptr)
+        {
+            not_full.park_until([this, &item]
+            {
+                return queued.load(std::memory_order_relaxed) < max_tasks || (item = pull_task()) != nullptr;
+            });
+        }
+
+        if (item != nullptr)
+        {
+            execute(item);
+        }
+    }
+}
+
+auto jobxx::_detail::queue_impl::spawn_task_on(int worker, delegate&& work, _detail::job_impl* parent) -> spawn_result
+{
+    if (!work)
+    {
+        return spawn_result::empty_function;
+    }
+
+    // only workers that have registered, and not yet left, can be sent
+    // tasks; they would otherwise wait for the queue to be destroyed.
+    if (worker < 0 || worker >= max_workers || !mailboxes[worker].open.load(std::memory_order_seq_cst))
+    {
+        return spawn_result::invalid_worker;
+    }
+
+    if (closed.load(std::memory_order_acquire))
+    {
+        return spawn_result::queue_closed;
+    }
+
+    if (parent != nullptr)
+    {
+        add_task(parent);
+    }
+
+    mailbox& inbox = mailboxes[worker];
+    inbox.tasks.push_back(new _detail::task{std::move(work), parent});
+    inbox.pending.fetch_add(1, std::memory_order_release);
+
+    // the worker may have left since we looked, and already drained its
+    // mailbox; if so, whatever is in it now is ours to share.
+    if (!inbox.open.load(std::memory_order_seq_cst))
+    {
+        drain_mailbox(inbox);
+    }
+    else if (!inbox.waiting.unpark_one())
+    {
+        wake_poller();
+    }
+
+    return spawn_result::success;
+}
+
+int jobxx::_detail::queue_impl::acquire_worker()
+{
+    static_assert(max_workers <= 64, "worker ids must fit in used_workers");
+
+    std::uint64_t used = used_workers.load(std::memory_order_relaxed);
+    int index = 0;
+    do
+    {
+        for (index = 0; index != max_workers && (used & (std::uint64_t(1) << index)) != 0; ++index)
+        {
+        }
+        if (index == max_workers)
+        {
+            return -1;
+        }
+    } while (!used_workers.compare_exchange_weak(used, used | (std::uint64_t(1) << index), std::memory_order_acquire, std::memory_order_relaxed));
+
+    // a reused id is already counted
+    int highest = next_worker.load(std::memory_order_relaxed);
+    while (highest <= index && !next_worker.compare_exchange_weak(highest, index + 1, std::memory_order_relaxed))
+    {
+        // highest is reloaded by the failed exchange
+    }
+    return index;
+}
+
+void jobxx::_detail::queue_impl::release_worker(int index)
+{
+    // released, so that the next owner of the id sees the last one's
+    // use of anything kept per worker, such as a combinable's slot.
+    used_workers.fetch_and(~(std::uint64_t(1) << index), std::memory_order_release);
+}
+
+void jobxx::_detail::queue_impl::drain_mailbox(mailbox& inbox)
+{
+    _detail::task* item = nullptr;
+    while (inbox.tasks.pop_front(item))
+    {
+        inbox.pending.fetch_sub(1, std::memory_order_relaxed);
+
+        // targeted tasks took no slot, but shared ones are counted
+        reserve_slot(/*force=*/true);
+        push_task(item);
+        item = nullptr;
+    }
+}
+
+auto jobxx::_detail::queue_impl::spawn_urgent_task(delegate&& work, _detail::job_impl* parent) -> spawn_result
+{
+    if (!work)
+    {
+        return spawn_result::empty_function;
+    }
+
+    if (closed.load(std::memory_order_acquire))
+    {
+        return spawn_result::queue_closed;
+    }
+
+    if (parent != nullptr)
+    {
+        add_task(parent);
+    }
+
+    urgent_tasks.push_back(new _detail::task{std::move(work), parent});
+    urgent_pending.fetch_add(1, std::memory_order_release);
+
+    // an urgent worker if one is free, otherwise any other
+    if (!urgent_waiting.unpark_one() && !waiting.unpark_one())
+    {
+        wake_poller();
+    }
+
+    return spawn_result::success;
+}
+
+jobxx::_detail::task* jobxx::_detail::queue_impl::pull_urgent()
+{
+    _detail::task* item = nullptr;
+    if (urgent_pending.load(std::memory_order_acquire) != 0 && urgent_tasks.pop_front(item))
+    {
+        urgent_pending.fetch_sub(1, std::memory_order_relaxed);
+        return item;
+    }
+    return nullptr;
+}
+
+jobxx::_detail::task* jobxx::_detail::queue_impl::pull_task()
+{
+    // urgent tasks come before everything else, even the LIFO slot
+    jobxx::_detail::task* item = pull_urgent();
+    if (item != nullptr)
+    {
+        return item;
+    }
+
+    worker_state* const worker = local_worker();
+    mailbox* const slot_owner = worker != nullptr ? worker->inbox : nullptr;
+    if (slot_owner != nullptr && slot_owner->next_task.load(std::memory_order_relaxed) != nullptr)
+    {
+        // the slot's task may have been stolen since we looked
+        item = slot_owner->next_task.exchange(nullptr, std::memory_order_acquire);
+        if (item != nullptr)
+        {
+            // bound how long a pair of tasks spawning one another can keep
+            // the thread to themselves: past the limit, the slot's task goes
+            // to the back of the shared queue like any other.
+            if (worker->lifo_streak < max_lifo_streak)
+            {
+                ++worker->lifo_streak;
+                release_slot();
+                return item;
+            }
+
+            push_task(item);
+            item = nullptr;
+        }
+    }
+
+    if (worker != nullptr)
+    {
+        worker->lifo_streak = 0;
+
+        // tasks that only we can run come before shared ones
+        mailbox* const inbox = worker->inbox;
+        if (inbox != nullptr && inbox->pending.load(std::memory_order_acquire) != 0 && inbox->tasks.pop_front(item))
+        {
+            inbox->pending.fetch_sub(1, std::memory_order_relaxed);
+            return item;
+        }
+
+        // the rest of the last batch comes before another visit
+        if (inbox != nullptr)
+        {
+            item = inbox->batch.take();
+            if (item == nullptr)
+            {
+                // no taking more than our share while others are idle
+                int const wanted = idle_workers.load(std::memory_order_relaxed) != 0 ? 1 : worker->batch_size;
+                _detail::task* taken[max_task_batch];
+                int const count = static_cast<int>(tasks.pop_front(taken, static_cast<std::size_t>(wanted)));
+                if (count == wanted && wanted == worker->batch_size)
+                {
+                    worker->batch_size = std::min(worker->batch_size * 2, max_task_batch);
+                }
+                else if (count < wanted)
+                {
+                    worker->batch_size = std::max(worker->batch_size / 2, 1);
+                }
+
+                if (count != 0)
+                {
+                    item = taken[0];
+                    inbox->batch.fill(taken + 1, count - 1);
+                }
+            }
+
+            if (item != nullptr)
+            {
+                // workers that go idle from here on find the rest of the
+                // batch and steal it, and those idle already are given it
+                if (!inbox->batch.empty())
+                {
+                    if (idle_workers.load(std::memory_order_seq_cst) != 0)
+                    {
+                        return_batch(*worker);
+                    }
+                    else
+                    {
+                        prefetch(inbox->batch.front());
+                    }
+                }
+                release_slot();
+                return item;
+            }
+        }
+    }
+
+    if ((worker == nullptr || worker->inbox == nullptr) && tasks.pop_front(item)) // on failure, item is left unmodified, e.g. nullptr
+    {
+        release_slot();
+        return item;
+    }
+
+    item = steal_task();
+    if (item == nullptr && worker != nullptr)
+    {
+        // we're about to go idle, so nothing may be held back
+        flush_retired(*worker);
+    }
+    return item;
+}
+
+void jobxx::_detail::queue_impl::return_batch(worker_state& worker)
+{
+    if (worker.inbox == nullptr)
+    {
+        return;
+    }
+
+    // whatever thieves haven't taken yet goes back in its original order
+    _detail::task* rest[max_task_batch];
+    int const count = worker.inbox->batch.take_all(rest);
+    if (count != 0)
+    {
+        tasks.push_front(rest, static_cast<std::size_t>(count));
+
+        // others may be asleep, believing the queue empty
+        for (int woken = 0; woken != count; ++woken)
+        {
+            if (!waiting.unpark_one())
+            {
+                wake_poller();
+                break;
+            }
+        }
+    }
+}
+
+void jobxx::_detail::queue_impl::release_held_tasks(worker_state& worker)
+{
+    flush_retired(worker);
+    return_batch(worker);
+
+    if (worker.inbox != nullptr)
+    {
+        if (_detail::task* const next = worker.inbox->next_task.exchange(nullptr, std::memory_order_acquire))
+        {
+            push_task(next);
+        }
+    }
+}
+
+void jobxx::_detail::queue_impl::push_task(_detail::task* item)
+{
+    tasks.push_back(item);
+    if (!waiting.unpark_one())
+    {
+        wake_poller();
+    }
+}
+
+bool jobxx::_detail::queue_impl::push_join(_detail::task* item)
+{
+    worker_state* const worker = local_worker();
+    if (worker == nullptr || worker->inbox == nullptr)
+    {
+        return false;
+    }
+
+    bool empty = false;
+    if (!worker->inbox->joins.push(item, empty))
+    {
+        return false;
+    }
+
+    // one idle worker is enough: once it has stolen this, it will come
+    // back for anything pushed after it.
+    if (empty && !waiting.unpark_one())
+    {
+        wake_poller();
+    }
+    return true;
+}
+
+bool jobxx::_detail::queue_impl::pop_join(_detail::task* item)
+{
+    // only ever called after a successful push_join by the same thread
+    _detail::task* const popped = local_worker()->inbox->joins.pop();
+    return popped == item;
+}
+
+jobxx::_detail::task* jobxx::_detail::queue_impl::steal_task()
+{
+    // start just past our own mailbox, so that thieves spread out
+    worker_state* const worker = local_worker();
+    int const workers = std::min(next_worker.load(std::memory_order_relaxed), max_workers);
+    int const start = worker != nullptr && worker->index >= 0 ? worker->index + 1 : 0;
+    for (int offset = 0; offset != workers; ++offset)
+    {
+        mailbox& victim = mailboxes[(start + offset) % workers];
+
+        // stolen halves of joins take no slot
+        if (_detail::task* const item = victim.joins.steal())
+        {
+            return item;
+        }
+
+        if (victim.next_task.load(std::memory_order_seq_cst) != nullptr)
+        {
+            if (_detail::task* const item = victim.next_task.exchange(nullptr, std::memory_order_acquire))
+            {
+                release_slot();
+                return item;
+            }
+        }
+
+        if (_detail::task* const item = victim.batch.take())
+        {
+            release_slot();
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+bool jobxx::_detail::queue_impl::stealable() const
+{
+    int const workers = std::min(next_worker.load(std::memory_order_relaxed), max_workers);
+    for (int index = 0; index != workers; ++index)
+    {
+        mailbox const& victim = mailboxes[index];
+        if (victim.next_task.load(std::memory_order_seq_cst) != nullptr || !victim.batch.empty() ||
+            victim.joins.top.load(std::memory_order_relaxed) < victim.joins.bottom.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void jobxx::_detail::queue_impl::wait_until(park& target, predicate ready)
+{
+    worker_scope scope(*this);
+
+    while (!ready())
+    {
+        if (_detail::task* const next = pull_task())
+        {
+            execute(next);
+            continue;
+        }
+
+        _detail::task* item = nullptr;
+        auto task_available = [this, &item]{ return (item = pull_task()) != nullptr; };
+
+        mailbox* const inbox = scope.inbox();
+        park_target const targets[] = {{&target, ready}, {&waiting, task_available}, {inbox != nullptr ? &inbox->waiting : nullptr, task_available}};
+        std::size_t const count = inbox != nullptr ? 3 : 2;
+        park_result const result = park::park_until_any(targets, count);
+
+        // as in _wait_job, being unparked by the task queue obliges
+        // us to act on the task it announced.
+        if (result >= park_result::second && item == nullptr)
+        {
+            item = pull_task();
+        }
+
+        if (item != nullptr)
+        {
+            execute(item);
+        }
+    }
+}
+
+namespace
+{
+    constexpr std::uint64_t pack_batch(std::uint64_t generation, std::uint64_t next, std::uint64_t end) { return (generation << 32) | (next << 16) | end; }
+    constexpr std::uint64_t generation_of(std::uint64_t state) { return state >> 32; }
+    constexpr int next_of(std::uint64_t state) { return static_cast<int>((state >> 16) & 0xffff); }
+    constexpr int end_of(std::uint64_t state) { return static_cast<int>(state & 0xffff); }
+}
+
+void jobxx::_detail::task_batch::fill(_detail::task* const* items, int count)
+{
+    for (int index = 0; index != count; ++index)
+    {
+        slots[index].store(items[index], std::memory_order_relaxed);
+    }
+
+    // publishing the batch must be visible before the owner looks for
+    // idle workers, so that one going idle either sees it or is seen.
+    std::uint64_t const current = state.load(std::memory_order_relaxed);
+    state.store(pack_batch(generation_of(current) + 1, 0, static_cast<std::uint64_t>(count)), std::memory_order_seq_cst);
+}
+
+jobxx::_detail::task* jobxx::_detail::task_batch::take()
+{
+    std::uint64_t current = state.load(std::memory_order_seq_cst);
+    while (next_of(current) != end_of(current))
+    {
+        // the slot is only read, so a stale read is harmless: the claim
+        // then fails on the new generation.
+        _detail::task* const item = slots[next_of(current)].load(std::memory_order_relaxed);
+        std::uint64_t const claimed = pack_batch(generation_of(current), static_cast<std::uint64_t>(next_of(current) + 1), static_cast<std::uint64_t>(end_of(current)));
+        if (state.compare_exchange_weak(current, claimed, std::memory_order_seq_cst, std::memory_order_seq_cst))
+        {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+int jobxx::_detail::task_batch::take_all(_detail::task** items)
+{
+    std::uint64_t current = state.load(std::memory_order_seq_cst);
+    while (next_of(current) != end_of(current))
+    {
+        int const count = end_of(current) - next_of(current);
+        for (int index = 0; index != count; ++index)
+        {
+            items[index] = slots[next_of(current) + index].load(std::memory_order_relaxed);
+        }
+        std::uint64_t const claimed = pack_batch(generation_of(current), static_cast<std::uint64_t>(end_of(current)), static_cast<std::uint64_t>(end_of(current)));
+        if (state.compare_exchange_weak(current, claimed, std::memory_order_seq_cst, std::memory_order_seq_cst))
+        {
+            return count;
+        }
+    }
+    return 0;
+}
+
+bool jobxx::_detail::task_batch::empty() const
+{
+    std::uint64_t const current = state.load(std::memory_order_seq_cst);
+    return next_of(current) == end_of(current);
+}
+
+jobxx::_detail::task* jobxx::_detail::task_batch::front() const
+{
+    std::uint64_t const current = state.load(std::memory_order_relaxed);
+    return next_of(current) != end_of(current) ? slots[next_of(current)].load(std::memory_order_relaxed) : nullptr;
+}
+
+bool jobxx::_detail::join_deque::push(_detail::task* item, bool& empty)
+{
+    std::int64_t const b = bottom.load(std::memory_order_relaxed);
+    std::int64_t const t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+    {
+        return false;
+    }
+
+    slots[b % capacity].store(item, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_seq_cst);
+    empty = b == t;
+    return true;
+}
+
+jobxx::_detail::task* jobxx::_detail::join_deque::pop()
+{
+    // claim the bottom item before looking at top, so that a thief
+    // either sees the claim or is seen by us.
+    std::int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    _detail::task* item = slots[b % capacity].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // the last item, which a thief may be taking right now
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            item = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+jobxx::_detail::task* jobxx::_detail::join_deque::steal()
+{
+    std::int64_t t = top.load(std::memory_order_seq_cst);
+    std::int64_t const b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    _detail::task* const item = slots[t % capacity].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return item;
+}
+
+void jobxx::_detail::queue_impl::wake_poller()
+{
+    // the worker sleeping in the poller isn't parked, so
+    // it must be woken separately.
+    if (io_poller.load(std::memory_order_relaxed) != nullptr)
+    {
+        if (poller* const io = acquire_poller())
+        {
+            io->wake();
+            release_poller();
+        }
+    }
+}
+
+auto jobxx::_detail::queue_impl::acquire_poller() -> poller*
+{
+    poller_users.fetch_add(1, std::memory_order_seq_cst);
+    poller* const io = io_poller.load(std::memory_order_seq_cst);
+    if (io == nullptr)
+    {
+        poller_users.fetch_sub(1, std::memory_order_release);
+    }
+    return io;
+}
+
+void jobxx::_detail::queue_impl::release_poller()
+{
+    poller_users.fetch_sub(1, std::memory_order_release);
+}
+
+auto jobxx::_detail::queue_impl::local_worker() const -> worker_state*
+{
+    worker_state* const worker = current_worker;
+    return worker != nullptr && worker->queue == this ? worker : nullptr;
+}
+
+bool jobxx::_detail::queue_impl::reserve_slot(bool force)
+{
+    if (!counts_tasks())
+    {
+        return true;
+    }
+
+    // optimistically take the slot and give it back if that
+    // overflowed; a racing spawn may briefly see the queue as
+    // full when it isn't, but never the other way around.
+    std::size_t const count = queued.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (!force && max_tasks != 0 && count > max_tasks)
+    {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (high_watermark != 0 && count >= high_watermark && !above_watermark.exchange(true, std::memory_order_relaxed) && on_watermark != nullptr)
+    {
+        on_watermark(watermark_data, true);
+    }
+
+    return true;
+}
+
+void jobxx::_detail::queue_impl::release_slot()
+{
+    if (!counts_tasks())
+    {
+        return;
+    }
+
+    std::size_t const count = queued.fetch_sub(1, std::memory_order_relaxed) - 1;
+
+    if (count <= low_watermark && above_watermark.load(std::memory_order_relaxed) && above_watermark.exchange(false, std::memory_order_relaxed) && on_watermark != nullptr)
+    {
+        on_watermark(watermark_data, false);
+    }
+
+    // a producer may be parked waiting for room
+    if (max_tasks != 0 && count < max_tasks)
+    {
+        not_full.unpark_one();
+    }
+}
+
+void jobxx::_detail::queue_impl::execute(_detail::task* item)
+{
+    _detail::job_impl* const parent = item->parent;
+    bool const owned = item->owned;
+
+    // completing a task of a job doesn't immediately touch the job's
+    // shared counter; a thread instead keeps a count of the tasks it has
+    // retired for the job it is working on, and only subtracts them once
+    // it moves on to a task of another job, runs out of work, is about to
+    // block, or returns from a wait to the task that was waiting. the
+    // job's completion is delayed by no more than a run of its own tasks,
+    // and a 100k-task fan-out touches the counter once per worker per run
+    // of the job's tasks rather than once per task.
+    worker_state* const worker = local_worker();
+    if (worker != nullptr && worker->retired_job != parent)
+    {
+        flush_retired(*worker);
+    }
+
+    // tasks of a cancelled job are drained without being run,
+    // but are otherwise retired normally so the job completes.
+    bool const cancelled = parent != nullptr && parent->cancelled.load(std::memory_order_relaxed);
+
+    // named jobs are charged for their tasks' time
+    bool const accounted = parent != nullptr && parent->account != nullptr && item->work && !cancelled;
+    std::uint64_t const nested_before = accounted ? nested_task_ns : 0;
+    std::uint64_t const start = accounted ? thread_cpu_ns() : 0;
+
+    if (item->work && !cancelled)
+    {
+        if (worker != nullptr)
+        {
+            ++worker->task_depth;
+        }
+        context ctx(*this, parent);
+        item->work(ctx);
+        if (worker != nullptr)
+        {
+            --worker->task_depth;
+        }
+    }
+
+    // a task that ran others while it waited is charged only for its own
+    // time, and all of it counts as nested for whatever task runs this one
+    std::uint64_t elapsed = 0;
+    if (accounted)
+    {
+        std::uint64_t const total = thread_cpu_ns() - start;
+        std::uint64_t const nested = nested_task_ns - nested_before;
+        elapsed = total - std::min(nested, total);
+        nested_task_ns = nested_before + total;
+    }
+
+    // the task is no longer needed (and one that isn't ours may
+    // already be gone, if its work completed whatever embeds it)
+    if (owned)
+    {
+        delete item;
+    }
+
+    if (parent != nullptr)
+    {
+        if (worker != nullptr)
+        {
+            // the task may have run others, of other jobs, while it
+            // waited; their completions are still held back
+            if (worker->retired_job != parent)
+            {
+                flush_retired(*worker);
+            }
+
+            worker->retired_job = parent;
+            ++worker->retired_tasks;
+            if (accounted)
+            {
+                ++worker->accounted_tasks;
+                worker->cpu_ns += elapsed;
+                worker->max_task_ns = std::max(worker->max_task_ns, elapsed);
+            }
+        }
+        else
+        {
+            if (accounted)
+            {
+                charge(*parent, 1, elapsed, elapsed);
+            }
+            retire_tasks(parent, 1);
+        }
+    }
+}
+
+void jobxx::_detail::queue_impl::add_task(_detail::job_impl* parent)
+{
+    // a thread spawning into the job whose completions it is holding back
+    // can simply cancel one of those out, without touching the job at all.
+    worker_state* const worker = local_worker();
+    if (worker != nullptr && worker->retired_job == parent && worker->retired_tasks != 0)
+    {
+        --worker->retired_tasks;
+        return;
+    }
+
+    // increment the number of pending tasks
+    // and if this is the first task, add a
+    // reference so the job isn't deleted
+    // before the task completes. we only do
+    // this count on the first/last task to
+    // avoid excessive reference counting.
+    if (0 == parent->tasks.fetch_add(1, std::memory_order_relaxed))
+    {
+        ++parent->refs;
+    }
+}
+
+void jobxx::_detail::queue_impl::retire_tasks(_detail::job_impl* parent, int count)
+{
+    // decrement the number of outstanding
+    // tasks. if this is the last task that
+    // was pending, also remove the reference
+    // count we added when the first task was
+    // added, since there are no longer any
+    // tasks referencing the job.
+    if (count == parent->tasks.fetch_sub(count, std::memory_order_acq_rel))
+    {
+        // no task remains that could be using the job's scratch memory
+        delete parent->scratch.exchange(nullptr, std::memory_order_acq_rel);
+
+        // awaken any parked threads awaiting the job
+        parent->waiting.unpark_all();
+
+        // and queue up the tasks waiting for it, which can't be refused
+        // for capacity since they were spawned long ago.
+        _detail::task* waiter = parent->continuations.exchange(job_impl::completed(), std::memory_order_acq_rel);
+        while (waiter != nullptr)
+        {
+            _detail::task* const next = waiter->next;
+            reserve_slot(/*force=*/true);
+            push_task(waiter);
+            waiter = next;
+        }
+
+        if (0 == --parent->refs)
+        {
+            delete parent;
+        }
+    }
+}
+
+void jobxx::_detail::queue_impl::flush_retired(worker_state& worker)
+{
+    // the job's figures must be in before the job can complete
+    if (worker.accounted_tasks != 0)
+    {
+        charge(*worker.retired_job, static_cast<std::uint64_t>(worker.accounted_tasks), worker.cpu_ns, worker.max_task_ns);
+        worker.accounted_tasks = 0;
+        worker.cpu_ns = 0;
+        worker.max_task_ns = 0;
+    }
+
+    if (worker.retired_tasks != 0)
+    {
+        retire_tasks(worker.retired_job, worker.retired_tasks);
+    }
+    worker.retired_job = nullptr;
+    worker.retired_tasks = 0;
+}
+
+auto jobxx::_detail::queue_impl::find_account(char const* name) -> job_account*
+{
+    std::lock_guard<std::mutex> _(accounts_lock);
+    return &accounts[name];
 }
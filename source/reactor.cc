@@ -0,0 +1,342 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/reactor.h"
+
+#if defined(__linux__)
+
+#include "jobxx/queue.h"
+#include "jobxx/spinlock.h"
+#include "jobxx/_detail/queue_impl.h"
+#include "jobxx/_detail/task.h"
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+    struct operation
+    {
+        jobxx::io_request* request = nullptr;
+        jobxx::delegate continuation;
+        jobxx::_detail::job_impl* parent = nullptr;
+        bool write = false;
+
+        // pending operations are kept in a list so that the
+        // reactor can clean up any still pending when destroyed.
+        operation* next = this;
+        operation* prev = this;
+    };
+}
+
+struct jobxx::reactor::impl : _detail::poller
+{
+    impl(_detail::queue_impl& queue, int epoll, int event);
+    ~impl() override;
+
+    bool poll(predicate ready) override;
+    void wake() override;
+
+    spawn_result submit(io_request& request, delegate&& continuation, _detail::job_impl* parent, bool write);
+    void complete(operation* op, bool perform);
+
+    void link(operation* op);
+    void unlink(operation* op);
+
+    _detail::queue_impl& queue;
+    int epoll = -1;
+    int event = -1;
+
+    // only one worker polls at a time, and the flag
+    // lets wake() skip the syscall if it's not asleep.
+    std::atomic<bool> polling = false;
+    std::atomic<bool> sleeping = false;
+
+    spinlock lock;
+    operation pending;
+};
+
+jobxx::reactor::impl::impl(_detail::queue_impl& queue, int epoll, int event) : queue(queue), epoll(epoll), event(event)
+{
+    // the workers may all be parked already, and one of them must
+    // come and sleep in here instead.
+    queue.io_poller.store(this, std::memory_order_seq_cst);
+    queue.waiting.unpark_one();
+}
+
+jobxx::reactor::impl::~impl()
+{
+    // stop workers from sleeping in here, and wait for
+    // any that already are (or are about to) to leave.
+    queue.io_poller.store(nullptr, std::memory_order_seq_cst);
+    while (queue.poller_users.load(std::memory_order_seq_cst) != 0)
+    {
+        wake();
+        std::this_thread::yield();
+    }
+
+    // operations still pending will never complete, so they're cancelled;
+    // their continuations run here, as nothing may be left to run them
+    // if the queue is going away too.
+    while (pending.next != &pending)
+    {
+        operation* const op = pending.next;
+        unlink(op);
+        op->request->result = -ECANCELED;
+        queue.execute(new _detail::task{std::move(op->continuation), op->parent});
+        delete op;
+    }
+
+    close(event);
+    close(epoll);
+}
+
+bool jobxx::reactor::impl::poll(predicate ready)
+{
+    bool expected = false;
+    if (!polling.compare_exchange_strong(expected, true, std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    // announce that we're about to sleep before the final check for work,
+    // so that work arriving after the check is certain to wake us.
+    sleeping.store(true, std::memory_order_seq_cst);
+    int const timeout = ready() ? 0 : -1;
+
+    constexpr int max_events = 32;
+    epoll_event events[max_events];
+    int const count = epoll_wait(epoll, events, max_events, timeout);
+    sleeping.store(false, std::memory_order_relaxed);
+
+    int completed = 0;
+    for (int index = 0; index < count; ++index)
+    {
+        operation* const op = static_cast<operation*>(events[index].data.ptr);
+        if (op == nullptr)
+        {
+            std::uint64_t drained;
+            while (::read(event, &drained, sizeof(drained)) > 0)
+            {
+                // consume all pending wakeups
+            }
+        }
+        else
+        {
+            complete(op, true);
+            ++completed;
+        }
+    }
+
+    polling.store(false, std::memory_order_release);
+
+    // we're about to go run the continuations we just spawned, so
+    // hand the polling over to another idle worker, if there is one.
+    if (completed != 0)
+    {
+        queue.waiting.unpark_one();
+    }
+
+    return true;
+}
+
+void jobxx::reactor::impl::wake()
+{
+    if (sleeping.exchange(false, std::memory_order_seq_cst))
+    {
+        std::uint64_t const one = 1;
+        ssize_t const written = ::write(event, &one, sizeof(one));
+        (void)written; // a full eventfd is still readable, so there's nothing to handle
+    }
+}
+
+auto jobxx::reactor::impl::submit(io_request& request, delegate&& continuation, _detail::job_impl* parent, bool write) -> spawn_result
+{
+    if (!continuation)
+    {
+        return spawn_result::empty_function;
+    }
+
+    if (queue.closed.load(std::memory_order_acquire))
+    {
+        return spawn_result::queue_closed;
+    }
+
+    // the continuation counts as a task of the job from now on
+    if (parent != nullptr)
+    {
+        queue.add_task(parent);
+    }
+
+    operation* const op = new operation{&request, std::move(continuation), parent, write};
+
+    // the operation may complete on another thread the moment it's
+    // registered, so it must be linked in first.
+    link(op);
+
+    epoll_event ready = {};
+    ready.events = (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ready.data.ptr = op;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, request.fd, &ready) == 0)
+    {
+        return spawn_result::success;
+    }
+
+    // epoll refuses regular files, which are always ready anyway; any
+    // other failure is reported to the continuation.
+    int const error = errno;
+    unlink(op);
+    if (error == EPERM)
+    {
+        complete(op, true);
+    }
+    else
+    {
+        request.result = -error;
+        complete(op, false);
+    }
+
+    return spawn_result::success;
+}
+
+void jobxx::reactor::impl::complete(operation* op, bool perform)
+{
+    io_request& request = *op->request;
+
+    if (perform)
+    {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, request.fd, nullptr);
+        unlink(op);
+
+        ssize_t const transferred = op->write ?
+            ::write(request.fd, request.buffer, request.size) :
+            ::read(request.fd, request.buffer, request.size);
+        request.result = transferred < 0 ? -errno : static_cast<long>(transferred);
+    }
+
+    // the task was already counted against its job when submitted, and
+    // completions must never be refused for capacity.
+    queue.reserve_slot(/*force=*/true);
+    queue.push_task(new _detail::task{std::move(op->continuation), op->parent});
+
+    delete op;
+}
+
+void jobxx::reactor::impl::link(operation* op)
+{
+    std::lock_guard<spinlock> _(lock);
+
+    op->next = &pending;
+    op->prev = pending.prev;
+    op->prev->next = op;
+    pending.prev = op;
+}
+
+void jobxx::reactor::impl::unlink(operation* op)
+{
+    std::lock_guard<spinlock> _(lock);
+
+    op->next->prev = op->prev;
+    op->prev->next = op->next;
+    op->next = op->prev = op;
+}
+
+jobxx::reactor::reactor(queue& queue)
+{
+    int const epoll = epoll_create1(EPOLL_CLOEXEC);
+    int const event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    // the eventfd is the only registration without an operation
+    epoll_event wakeup = {};
+    wakeup.events = EPOLLIN;
+    wakeup.data.ptr = nullptr;
+    if (epoll < 0 || event < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, event, &wakeup) != 0)
+    {
+        if (event >= 0)
+        {
+            close(event);
+        }
+        if (epoll >= 0)
+        {
+            close(epoll);
+        }
+        return;
+    }
+
+    _impl = new impl(*queue._impl, epoll, event);
+}
+
+jobxx::reactor::~reactor()
+{
+    delete _impl;
+}
+
+auto jobxx::reactor::read(io_request& request, delegate&& continuation) -> spawn_result
+{
+    if (_impl == nullptr)
+    {
+        return spawn_result::invalid_reactor;
+    }
+    return _impl->submit(request, std::move(continuation), nullptr, false);
+}
+
+auto jobxx::reactor::write(io_request& request, delegate&& continuation) -> spawn_result
+{
+    if (_impl == nullptr)
+    {
+        return spawn_result::invalid_reactor;
+    }
+    return _impl->submit(request, std::move(continuation), nullptr, true);
+}
+
+auto jobxx::reactor::read(context& ctx, io_request& request, delegate&& continuation) -> spawn_result
+{
+    if (_impl == nullptr)
+    {
+        return spawn_result::invalid_reactor;
+    }
+    return _impl->submit(request, std::move(continuation), ctx._job, false);
+}
+
+auto jobxx::reactor::write(context& ctx, io_request& request, delegate&& continuation) -> spawn_result
+{
+    if (_impl == nullptr)
+    {
+        return spawn_result::invalid_reactor;
+    }
+    return _impl->submit(request, std::move(continuation), ctx._job, true);
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,72 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/sender.h"
+#include "jobxx/_detail/job_impl.h"
+#include "jobxx/_detail/queue_impl.h"
+
+auto jobxx::queue::get_scheduler() -> scheduler
+{
+    return scheduler(*this);
+}
+
+auto jobxx::_detail::sender_access::spawn(queue& target, task& node) -> spawn_result
+{
+    return target._impl->spawn_node(&node);
+}
+
+bool jobxx::_detail::sender_access::await(job const& awaited, task& node)
+{
+    job_impl* const impl = awaited._impl;
+    if (impl == nullptr || impl->tasks.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+
+    // the job may complete at any moment; once it has, the list is
+    // closed for good and the caller completes the node itself.
+    task* head = impl->continuations.load(std::memory_order_acquire);
+    do
+    {
+        if (head == job_impl::completed())
+        {
+            return false;
+        }
+        node.next = head;
+    } while (!impl->continuations.compare_exchange_weak(head, &node, std::memory_order_acq_rel, std::memory_order_acquire));
+
+    return true;
+}
+
+void jobxx::_detail::sender_access::wait(queue& helper, park& target, predicate ready)
+{
+    helper._wait_until(target, ready);
+}
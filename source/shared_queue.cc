@@ -0,0 +1,371 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/shared_queue.h"
+
+#if defined(__linux__)
+
+#include "jobxx/queue.h"
+#include "jobxx/_detail/cache_line.h"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::uint32_t magic = 0x6a6f6278; // "jobx"
+
+    // the futex calls are deliberately not FUTEX_PRIVATE_FLAG: the
+    // whole point is that other processes wait on the same word.
+    void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected)
+    {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+    }
+
+    void futex_wake(std::atomic<std::uint32_t>& word, int count)
+    {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+    }
+}
+
+// everything in the mapping must work at any address in any process
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "jobxx::shared_queue requires lock-free 64-bit atomics");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "jobxx::shared_queue requires lock-free 32-bit atomics");
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex words must be plain 32-bit integers");
+
+struct jobxx::shared_queue::header
+{
+    std::uint32_t magic;
+    std::uint32_t capacity;
+
+    // the ring is a bounded MPMC queue in the style of Dmitry Vyukov's:
+    // each slot's sequence says whether it's ready to be written or read
+    // for a given position, so producers and consumers only contend on
+    // their own cursor.
+    alignas(_detail::cache_line_size) std::atomic<std::uint64_t> enqueue_pos;
+    alignas(_detail::cache_line_size) std::atomic<std::uint64_t> dequeue_pos;
+
+    // bumped on every wakeup, so that a worker about to wait can tell
+    // whether it missed one.
+    alignas(_detail::cache_line_size) std::atomic<std::uint32_t> wakeups;
+    std::atomic<std::uint32_t> sleepers;
+    std::atomic<std::uint32_t> closed;
+};
+
+struct jobxx::shared_queue::slot
+{
+    std::atomic<std::uint64_t> sequence;
+    std::uint32_t function;
+    std::uint32_t size;
+    unsigned char payload[max_payload];
+};
+
+jobxx::shared_queue::~shared_queue()
+{
+    if (_header != nullptr)
+    {
+        munmap(_header, _mapped_size);
+    }
+    if (_fd != -1)
+    {
+        ::close(_fd);
+    }
+}
+
+bool jobxx::shared_queue::create(std::size_t capacity, int fd)
+{
+    if (_header != nullptr || capacity == 0 || (capacity & (capacity - 1)) != 0 || capacity > UINT32_MAX)
+    {
+        return false;
+    }
+
+    bool const anonymous = fd == -1;
+    if (anonymous)
+    {
+        fd = memfd_create("jobxx", MFD_CLOEXEC);
+        if (fd == -1)
+        {
+            return false;
+        }
+    }
+
+    std::size_t const size = sizeof(header) + capacity * sizeof(slot);
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !_map(fd, true, capacity))
+    {
+        if (anonymous)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool jobxx::shared_queue::open(int fd)
+{
+    if (_header != nullptr)
+    {
+        return false;
+    }
+
+    // touching a mapping past the end of its file faults, so the file
+    // must be as big as the header and, below, as the ring it describes
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(header))
+    {
+        return false;
+    }
+
+    // the header tells us how big the rest of the mapping is
+    header* const peek = static_cast<header*>(mmap(nullptr, sizeof(header), PROT_READ, MAP_SHARED, fd, 0));
+    if (peek == MAP_FAILED)
+    {
+        return false;
+    }
+    bool const valid = peek->magic == magic;
+    std::size_t const capacity = peek->capacity;
+    munmap(peek, sizeof(header));
+
+    if (!valid || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        static_cast<std::size_t>(info.st_size) < sizeof(header) + capacity * sizeof(slot))
+    {
+        return false;
+    }
+    return _map(fd, false, capacity);
+}
+
+bool jobxx::shared_queue::_map(int fd, bool initialize, std::size_t capacity)
+{
+    std::size_t const size = sizeof(header) + capacity * sizeof(slot);
+    void* const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _fd = fd;
+    _mapped_size = size;
+    _header = static_cast<header*>(memory);
+    _slots = reinterpret_cast<slot*>(static_cast<unsigned char*>(memory) + sizeof(header));
+
+    if (initialize)
+    {
+        // the file starts out zeroed, so only the non-zero parts need
+        // setting up; the magic goes last to publish the rest.
+        for (std::size_t index = 0; index != capacity; ++index)
+        {
+            new (&_slots[index].sequence) std::atomic<std::uint64_t>(index);
+        }
+        new (&_header->enqueue_pos) std::atomic<std::uint64_t>(0);
+        new (&_header->dequeue_pos) std::atomic<std::uint64_t>(0);
+        new (&_header->wakeups) std::atomic<std::uint32_t>(0);
+        new (&_header->sleepers) std::atomic<std::uint32_t>(0);
+        new (&_header->closed) std::atomic<std::uint32_t>(0);
+        _header->capacity = static_cast<std::uint32_t>(capacity);
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->magic = magic;
+    }
+
+    return true;
+}
+
+bool jobxx::shared_queue::register_function(int index, function fn)
+{
+    if (index < 0 || index >= max_functions)
+    {
+        return false;
+    }
+    _functions[index] = fn;
+    return true;
+}
+
+auto jobxx::shared_queue::spawn_task(int function, void const* payload, std::size_t size) -> spawn_result
+{
+    if (function < 0 || function >= max_functions)
+    {
+        return spawn_result::empty_function;
+    }
+    if (size > max_payload)
+    {
+        return spawn_result::invalid_payload;
+    }
+    if (_header->closed.load(std::memory_order_acquire) != 0)
+    {
+        return spawn_result::queue_closed;
+    }
+
+    std::uint64_t const mask = _header->capacity - 1;
+    std::uint64_t position = _header->enqueue_pos.load(std::memory_order_relaxed);
+    slot* target = nullptr;
+    for (;;)
+    {
+        target = &_slots[position & mask];
+        std::uint64_t const sequence = target->sequence.load(std::memory_order_acquire);
+        std::int64_t const difference = static_cast<std::int64_t>(sequence - position);
+        if (difference == 0)
+        {
+            if (_header->enqueue_pos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // the slot still holds the task from a lap ago
+            return spawn_result::queue_full;
+        }
+        else
+        {
+            position = _header->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    target->function = static_cast<std::uint32_t>(function);
+    target->size = static_cast<std::uint32_t>(size);
+    if (size != 0)
+    {
+        std::memcpy(target->payload, payload, size);
+    }
+    target->sequence.store(position + 1, std::memory_order_release);
+
+    // as with park, the sleeper announces itself before its last look at
+    // the ring, so either it sees this task or we see it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_header->sleepers.load(std::memory_order_relaxed) != 0)
+    {
+        _header->wakeups.fetch_add(1, std::memory_order_release);
+        futex_wake(_header->wakeups, 1);
+    }
+
+    return spawn_result::success;
+}
+
+bool jobxx::shared_queue::work_one()
+{
+    std::uint64_t const mask = _header->capacity - 1;
+    std::uint64_t position = _header->dequeue_pos.load(std::memory_order_relaxed);
+    slot* source = nullptr;
+    for (;;)
+    {
+        source = &_slots[position & mask];
+        std::uint64_t const sequence = source->sequence.load(std::memory_order_acquire);
+        std::int64_t const difference = static_cast<std::int64_t>(sequence - (position + 1));
+        if (difference == 0)
+        {
+            if (_header->dequeue_pos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = _header->dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // copy the task out so that the slot can be reused while it runs
+    std::uint32_t const function = source->function;
+    std::uint32_t const size = source->size;
+    unsigned char payload[max_payload];
+    if (size != 0)
+    {
+        std::memcpy(payload, source->payload, size);
+    }
+    source->sequence.store(position + _header->capacity, std::memory_order_release);
+
+    if (function < static_cast<std::uint32_t>(max_functions) && _functions[function] != nullptr)
+    {
+        _functions[function](payload, size);
+    }
+    else
+    {
+        ++_unhandled;
+    }
+    return true;
+}
+
+void jobxx::shared_queue::work_all()
+{
+    while (work_one())
+    {
+        // keep looping while there's work
+    }
+}
+
+bool jobxx::shared_queue::_ready() const
+{
+    std::uint64_t const position = _header->dequeue_pos.load(std::memory_order_relaxed);
+    std::uint64_t const sequence = _slots[position & (_header->capacity - 1)].sequence.load(std::memory_order_acquire);
+    return sequence == position + 1 || _header->closed.load(std::memory_order_relaxed) != 0;
+}
+
+void jobxx::shared_queue::work_forever()
+{
+    while (_header->closed.load(std::memory_order_acquire) == 0)
+    {
+        if (work_one())
+        {
+            continue;
+        }
+
+        _header->sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::uint32_t const seen = _header->wakeups.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_ready())
+        {
+            // returns at once if a wakeup came in since we looked
+            futex_wait(_header->wakeups, seen);
+        }
+        _header->sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    work_all();
+}
+
+void jobxx::shared_queue::close()
+{
+    _header->closed.store(1, std::memory_order_release);
+    _header->wakeups.fetch_add(1, std::memory_order_release);
+    futex_wake(_header->wakeups, INT_MAX);
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,102 @@
+
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/task_mutex.h"
+#include "jobxx/queue.h"
+
+namespace
+{
+    // long enough to ride out a short critical section on another
+    // core, short enough not to matter when the holder is descheduled.
+    constexpr int max_spins = 64;
+}
+
+bool jobxx::task_mutex::try_lock()
+{
+    return _locked.load(std::memory_order_relaxed) == false &&
+        _locked.exchange(true, std::memory_order_acquire) == /*old-value*/false;
+}
+
+bool jobxx::task_mutex::_spin()
+{
+    for (int spins = 0; spins < max_spins; ++spins)
+    {
+        if (try_lock())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void jobxx::task_mutex::lock()
+{
+    if (_spin())
+    {
+        return;
+    }
+
+    // announce ourselves before the final try_lock in the park
+    // predicate, so that an unlock after it is sure to wake us.
+    _waiters.fetch_add(1, std::memory_order_seq_cst);
+    bool acquired = false;
+    auto locked = [this, &acquired]{ return acquired || (acquired = try_lock()); };
+    while (!locked())
+    {
+        _waiting.park_until(locked);
+    }
+    _waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void jobxx::task_mutex::lock(queue& helper)
+{
+    if (_spin())
+    {
+        return;
+    }
+
+    _waiters.fetch_add(1, std::memory_order_seq_cst);
+    bool acquired = false;
+    auto locked = [this, &acquired]{ return acquired || (acquired = try_lock()); };
+    helper._wait_until(_waiting, locked);
+    _waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void jobxx::task_mutex::unlock()
+{
+    _locked.store(false, std::memory_order_seq_cst);
+
+    // the uncontended case never touches the park
+    if (_waiters.load(std::memory_order_seq_cst) != 0)
+    {
+        _waiting.unpark_one();
+    }
+}
@@ -30,12 +30,41 @@
 //   Sean Middleditch <sean.middleditch@gmail.com>
 
 #include "jobxx/queue.h"
+#include "jobxx/algorithm.h"
+#include "jobxx/basic_queue.h"
 #include "jobxx/job.h"
+#include "jobxx/join.h"
+#include "jobxx/park.h"
+#include "jobxx/channel.h"
+#include "jobxx/combinable.h"
+#include "jobxx/elastic_pool.h"
+#include "jobxx/task_mutex.h"
+#include "jobxx/pipeline.h"
+#include "jobxx/sender.h"
+#include "jobxx/reactor.h"
+#include "jobxx/shared_queue.h"
+#include "jobxx/urgent_lane.h"
 
 #include <thread>
+#include <mutex>
 #include <atomic>
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <new>
+#include <random>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
 
 // test utilities and helpers
 namespace
@@ -190,6 +219,1915 @@ namespace
         return true;
     }
 
+    static bool timeout_test()
+    {
+        worker_pool pool(1);
+
+        // a park that nobody will unpark must time out
+        jobxx::park park;
+        if (park.park_until_for([]{ return false; }, std::chrono::milliseconds(10)) != jobxx::park_result::timeout)
+        {
+            return false;
+        }
+
+        jobxx::job job = pool.queue().create_job([](jobxx::context& ctx)
+        {
+            ctx.spawn_task([](){ std::this_thread::sleep_for(std::chrono::milliseconds(250)); });
+        });
+
+        // wait on a queue that will never run work for the job,
+        // so that the first wait cannot complete in time
+        jobxx::queue queue;
+        if (queue.wait_job_for(job, std::chrono::milliseconds(10)) != jobxx::wait_result::timeout)
+        {
+            return false;
+        }
+
+        return queue.wait_job_until(job, std::chrono::steady_clock::now() + std::chrono::seconds(10)) == jobxx::wait_result::complete && job.complete();
+    }
+
+    static bool park_stress_test()
+    {
+        jobxx::park first;
+        jobxx::park second;
+        auto never = []{ return false; };
+        jobxx::park_target const both[] = {{&first, never}, {&second, never}};
+
+        // unparkers race timed parks that keep expiring, on one park or
+        // on both at once. as no predicate is ever satisfied, every
+        // unpark_one that reports waking a thread must be matched by
+        // exactly one park returning for that park's index: one too few
+        // is a lost wakeup, one too many a waiter woken twice.
+        {
+            constexpr int waiters = 4;
+            constexpr int rounds = 2000;
+            std::atomic<int> woken[2] = {{0}, {0}};
+            std::atomic<int> unparked[2] = {{0}, {0}};
+            std::atomic<int> failed = {0};
+            std::atomic<int> remaining = {waiters};
+
+            std::vector<std::thread> threads;
+            for (int index = 0; index != waiters; ++index)
+            {
+                threads.emplace_back([&, index]()
+                {
+                    for (int round = 0; round != rounds; ++round)
+                    {
+                        auto const timeout = std::chrono::microseconds((round + index) % 4);
+                        int const mode = (round + index) % 3;
+                        jobxx::park_result const result =
+                            mode == 0 ? first.park_until_for(never, timeout) :
+                            mode == 1 ? second.park_until_for(never, timeout) :
+                            jobxx::park::park_until_any_for(both, 2, timeout);
+                        if (result == jobxx::park_result::timeout)
+                        {
+                            continue;
+                        }
+                        if (result == jobxx::park_result::failure || (mode != 2 && result != jobxx::park_result::first))
+                        {
+                            ++failed;
+                            continue;
+                        }
+                        // a single park is woken as its only target
+                        ++woken[mode == 2 ? static_cast<int>(result) : mode];
+                    }
+                    --remaining;
+                });
+            }
+            for (int index = 0; index != 2; ++index)
+            {
+                threads.emplace_back([&, index]()
+                {
+                    jobxx::park* const parks[] = {&first, &second};
+                    for (int turn = index; remaining != 0; ++turn)
+                    {
+                        if (parks[turn % 2]->unpark_one())
+                        {
+                            ++unparked[turn % 2];
+                        }
+                    }
+                });
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            if (failed != 0 || woken[0] != unparked[0] || woken[1] != unparked[1])
+            {
+                return false;
+            }
+        }
+
+        // every waiter must be woken by unpark_all, even while others
+        // time out on the same park and unpark_one takes wakeups from
+        // the other. a waiter on both may be woken by either, leaving
+        // a stale node behind on the other for the next round.
+        {
+            constexpr int waiters = 4;
+            constexpr int rounds = 1000;
+            std::atomic<int> round = {0};
+            std::atomic<int> lost = {0};
+            std::atomic<bool> done = {false};
+
+            std::vector<std::thread> threads;
+            for (int index = 0; index != waiters; ++index)
+            {
+                threads.emplace_back([&, index]()
+                {
+                    for (int seen = round; seen != rounds; seen = round)
+                    {
+                        auto moved = [&round, seen]{ return round != seen; };
+                        jobxx::park_target const targets[] = {{&second, moved}, {&first, moved}};
+                        jobxx::park_result const result = index % 2 == 0 ?
+                            first.park_until_for(moved, std::chrono::seconds(5)) :
+                            jobxx::park::park_until_any_for(targets, 2, std::chrono::seconds(5));
+                        if (result == jobxx::park_result::timeout)
+                        {
+                            ++lost;
+                            return;
+                        }
+                    }
+                });
+            }
+            threads.emplace_back([&]()
+            {
+                while (!done)
+                {
+                    first.park_until_for(never, std::chrono::microseconds(20));
+                    second.unpark_one();
+                }
+            });
+
+            for (int index = 0; index != rounds; ++index)
+            {
+                ++round;
+                second.unpark_all();
+                first.unpark_all();
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+            done = true;
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            if (lost != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool wait_set_test()
+    {
+        worker_pool pool(2);
+
+        auto const sleeper = [&pool](int milliseconds)
+        {
+            return pool.queue().create_job([milliseconds](jobxx::context& ctx)
+            {
+                ctx.spawn_task([milliseconds](){ std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds)); });
+            });
+        };
+
+        jobxx::job slow = sleeper(1000);
+        jobxx::job fast = sleeper(10);
+        jobxx::job slower = sleeper(2000);
+
+        // wait on a queue that will never run work for the jobs
+        jobxx::queue queue;
+        if (queue.wait_any(slow, fast, slower) != 1 || !fast.complete() || slower.complete())
+        {
+            return false;
+        }
+
+        queue.wait_all(slow, fast, slower);
+        if (!slow.complete() || !fast.complete() || !slower.complete())
+        {
+            return false;
+        }
+
+        // more jobs than are kept on the stack, passed as an array; the
+        // waits are parked across all of them at once
+        constexpr std::size_t count = 9;
+        jobxx::job many[count];
+        jobxx::job const* pointers[count];
+        many[4] = sleeper(10);
+        for (std::size_t index = 0; index != count; ++index)
+        {
+            if (index != 4)
+            {
+                many[index] = sleeper(100 + 20 * static_cast<int>(index));
+            }
+            pointers[index] = &many[index];
+        }
+
+        if (queue.wait_any(pointers, count) != 4)
+        {
+            return false;
+        }
+
+        queue.wait_all(pointers, count);
+        for (jobxx::job const& awaited : many)
+        {
+            if (!awaited.complete())
+            {
+                return false;
+            }
+        }
+
+        // and a set that is already complete costs nothing
+        queue.wait_all(pointers, count);
+        return queue.wait_any(pointers, count) == 0;
+    }
+
+    static bool cancel_test()
+    {
+        // queued tasks of a cancelled job, including those they would spawn, never run
+        {
+            jobxx::queue queue;
+
+            int count = 0;
+            jobxx::job job = queue.create_job([&count](jobxx::context& ctx)
+            {
+                spawn_n(ctx, 8, [&count](jobxx::context& ctx)
+                {
+                    ++count;
+                    ctx.spawn_task([&count](){ ++count; });
+                });
+            });
+            job.cancel();
+            queue.wait_job_actively(job);
+
+            if (count != 0 || !job.complete() || !job.cancelled())
+            {
+                return false;
+            }
+        }
+
+        // running tasks may observe cancellation and bail out early
+        {
+            worker_pool pool(1);
+
+            std::atomic<bool> started(false);
+            jobxx::job job = pool.queue().create_job([&started](jobxx::context& ctx)
+            {
+                ctx.spawn_task([&started](jobxx::context& ctx)
+                {
+                    started = true;
+                    while (!ctx.cancelled())
+                    {
+                        std::this_thread::yield();
+                    }
+                });
+            });
+
+            while (!started)
+            {
+                std::this_thread::yield();
+            }
+            job.cancel();
+
+            jobxx::queue queue;
+            return queue.wait_job_for(job, std::chrono::seconds(10)) == jobxx::wait_result::complete;
+        }
+    }
+
+    static bool capacity_test()
+    {
+        struct watermarks
+        {
+            int high = 0;
+            int low = 0;
+        } marks;
+
+        jobxx::queue_capacity capacity;
+        capacity.max_tasks = 4;
+        capacity.high_watermark = 3;
+        capacity.low_watermark = 1;
+        capacity.user_data = &marks;
+        capacity.on_watermark = [](void* user_data, bool high)
+        {
+            ++(high ? static_cast<watermarks*>(user_data)->high : static_cast<watermarks*>(user_data)->low);
+        };
+        jobxx::queue queue(capacity);
+
+        int count = 0;
+        spawn_n(queue, 4, [&count](){ ++count; });
+        if (queue.spawn_task([&count](){ ++count; }) != jobxx::spawn_result::queue_full || marks.high != 1 || marks.low != 0)
+        {
+            return false;
+        }
+
+        // with no other threads, the blocking spawn must run a task to make room
+        if (queue.spawn_task_blocking([&count](){ ++count; }) != jobxx::spawn_result::success || count != 1)
+        {
+            return false;
+        }
+
+        queue.work_all();
+        if (count != 5 || marks.high != 1 || marks.low != 1)
+        {
+            return false;
+        }
+
+        queue.close();
+        return queue.spawn_task([](){}) == jobxx::spawn_result::queue_closed;
+    }
+
+    static bool inline_spawn_test()
+    {
+        jobxx::queue_capacity capacity;
+        capacity.inline_threshold = 4;
+        jobxx::queue queue(capacity);
+
+        // a task spawned behind a backlog runs before spawn_task returns
+        bool ran = false;
+        bool ran_inline = false;
+        jobxx::job job = queue.create_job([&](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&](jobxx::context& task_ctx)
+            {
+                task_ctx.spawn_task([&](){ ran = true; });
+                ran_inline = ran;
+            });
+            for (int i = 0; i < 10; ++i)
+            {
+                ctx.spawn_task([](){});
+            }
+        });
+        queue.wait_job_actively(job);
+        if (!ran_inline || !job.complete())
+        {
+            return false;
+        }
+
+        // without a backlog, it's queued as usual
+        ran = false;
+        ran_inline = true;
+        jobxx::job short_job = queue.create_job([&](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&](jobxx::context& task_ctx)
+            {
+                task_ctx.spawn_task([&](){ ran = true; });
+                ran_inline = ran;
+            });
+        });
+        queue.wait_job_actively(short_job);
+        return ran && !ran_inline;
+    }
+
+    static bool job_stats_test()
+    {
+        worker_pool pool(2);
+        jobxx::queue& queue = pool.queue();
+
+        auto spawn_busy_tasks = [](jobxx::context& ctx)
+        {
+            for (int i = 0; i < 50; ++i)
+            {
+                ctx.spawn_task([]()
+                {
+                    auto const until = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+                    while (std::chrono::steady_clock::now() < until)
+                    {
+                        // burn CPU time
+                    }
+                });
+            }
+        };
+
+        jobxx::job first = queue.create_job("stats_test", spawn_busy_tasks);
+        jobxx::job second = queue.create_job("stats_test", spawn_busy_tasks);
+        jobxx::job unnamed = queue.create_job(spawn_busy_tasks);
+        queue.wait_all(first, second, unnamed);
+
+        // complete jobs have all their figures in, and so do the totals
+        jobxx::job_stats const stats = first.stats();
+        jobxx::job_stats const totals = queue.stats_for("stats_test");
+        bool const charged = stats.jobs == 1 && stats.tasks == 50 &&
+            stats.max_task_time > std::chrono::nanoseconds::zero() && stats.cpu_time >= stats.max_task_time &&
+            totals.jobs == 2 && totals.tasks == 100 && totals.cpu_time > stats.cpu_time &&
+            unnamed.stats().tasks == 0 && queue.stats_for("unknown").jobs == 0;
+
+        // a task that waits on another job runs that job's tasks itself,
+        // but their time is charged to their own job and not to the waiter
+        jobxx::queue local;
+        jobxx::job inner;
+        jobxx::job outer = local.create_job("stats_outer", [&local, &inner](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&local, &inner]()
+            {
+                inner = local.create_job("stats_inner", [](jobxx::context& ctx)
+                {
+                    ctx.spawn_task([]()
+                    {
+                        auto const until = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+                        while (std::chrono::steady_clock::now() < until)
+                        {
+                            // burn CPU time
+                        }
+                    });
+                });
+                local.wait_job_actively(inner);
+            });
+        });
+        local.wait_job_actively(outer);
+
+        return charged && inner.stats().tasks == 1 && outer.stats().tasks == 1 &&
+            outer.stats().cpu_time < inner.stats().cpu_time / 2;
+    }
+
+    static bool lifo_slot_test()
+    {
+        jobxx::queue queue;
+
+        // a task spawned by a running task runs next, ahead of older tasks
+        std::vector<char> order;
+        queue.spawn_task([&order](jobxx::context& ctx)
+        {
+            order.push_back('p');
+            ctx.spawn_task([&order](){ order.push_back('c'); });
+        });
+        queue.spawn_task([&order](){ order.push_back('q'); });
+        queue.work_all();
+
+        if (order != std::vector<char>{'p', 'c', 'q'})
+        {
+            return false;
+        }
+
+        // a chain of tasks that keep respawning themselves can't starve the queue
+        struct chain
+        {
+            static void step(jobxx::context& ctx, int* steps, int* seen_at)
+            {
+                if (++*steps < 100)
+                {
+                    ctx.spawn_task([steps, seen_at](jobxx::context& ctx){ step(ctx, steps, seen_at); });
+                }
+            }
+        };
+
+        int steps = 0;
+        int seen_at = -1;
+        queue.spawn_task([&steps, &seen_at](jobxx::context& ctx){ chain::step(ctx, &steps, &seen_at); });
+        queue.spawn_task([&steps, &seen_at](){ seen_at = steps; });
+        queue.work_all();
+
+        // the older task must get its turn long before the chain finishes
+        return steps == 100 && seen_at >= 0 && seen_at <= 16;
+    }
+
+    static bool lifo_block_test()
+    {
+        worker_pool pool(4);
+
+        // a task that blocks waiting on the task it just spawned: the
+        // child must not be left in the blocked worker's LIFO slot
+        jobxx::channel<int> channel;
+        std::atomic<int> received(0);
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        for (int index = 0; index != 20; ++index)
+        {
+            pool.queue().spawn_task([&channel, &received](jobxx::context& ctx)
+            {
+                ctx.spawn_task([&channel](){ channel.send(1); });
+                int value = 0;
+                if (channel.recv(value) == jobxx::channel_result::success)
+                {
+                    received += value;
+                }
+            });
+            while (received != index + 1 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // and with every other worker busy when it spawns, so that the
+        // child has to be taken from the slot once one is free
+        std::atomic<bool> spawned(false);
+        std::atomic<int> busy(0);
+        for (int index = 0; index != 3; ++index)
+        {
+            pool.queue().spawn_task([&spawned, &busy]()
+            {
+                ++busy;
+                while (!spawned)
+                {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+        }
+        while (busy != 3 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::yield();
+        }
+        pool.queue().spawn_task([&channel, &received, &spawned](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&channel](){ channel.send(1); });
+            spawned = true;
+            int value = 0;
+            if (channel.recv(value) == jobxx::channel_result::success)
+            {
+                received += value;
+            }
+        });
+
+        while (received != 21 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (received != 21)
+        {
+            // unblock whatever is stuck so the pool can shut down
+            for (int index = 0; index != 21; ++index)
+            {
+                channel.send(0);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    static bool targeted_task_test()
+    {
+        worker_pool pool(2);
+
+        // main-thread tasks wait for the main thread to work
+        std::atomic<bool> ran(false);
+        std::thread::id ran_on;
+        pool.queue().spawn_task_on(jobxx::queue::main_thread, [&ran, &ran_on]()
+        {
+            ran_on = std::this_thread::get_id();
+            ran = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (ran)
+        {
+            return false;
+        }
+        pool.queue().work_all();
+        if (!ran || ran_on != std::this_thread::get_id())
+        {
+            return false;
+        }
+
+        // tasks targeted at a worker all run on that one worker
+        std::thread::id first;
+        std::thread::id second;
+        jobxx::job job = pool.queue().create_job([&first, &second](jobxx::context& ctx)
+        {
+            ctx.spawn_task_on(1, [&first](){ first = std::this_thread::get_id(); });
+            ctx.spawn_task_on(1, [&second](){ second = std::this_thread::get_id(); });
+        });
+        pool.queue().wait_job_actively(job);
+
+        // ids no worker has taken can't be sent anything
+        return first == second && first != std::this_thread::get_id() &&
+            pool.queue().spawn_task_on(jobxx::queue::max_workers, [](){}) == jobxx::spawn_result::invalid_worker &&
+            pool.queue().spawn_task_on(3, [](){}) == jobxx::spawn_result::invalid_worker;
+    }
+
+    static bool nested_wait_test()
+    {
+        jobxx::queue queue;
+        std::thread helper([&queue](){ queue.work_forever(); });
+
+        // a task of outer waits on awaited, which the helper holds open
+        // until the waiting thread has run some tasks of other meanwhile,
+        // so that it is still holding back their completions once
+        // awaited completes; they mustn't be counted against outer.
+        std::atomic<int> ran(0);
+        jobxx::job other;
+        jobxx::job outer = queue.create_job([&queue, &ran, &other](jobxx::context& ctx)
+        {
+            ctx.spawn_task_on(jobxx::queue::main_thread, [&queue, &ran, &other]()
+            {
+                jobxx::job awaited = queue.create_job([&ran](jobxx::context& ctx)
+                {
+                    // the helper may not have taken its id just yet
+                    auto hold = [&ran]()
+                    {
+                        while (ran < 2)
+                        {
+                            std::this_thread::yield();
+                        }
+                    };
+                    while (ctx.spawn_task_on(1, hold) == jobxx::spawn_result::invalid_worker)
+                    {
+                        std::this_thread::yield();
+                    }
+                });
+                other = queue.create_job([&ran](jobxx::context& ctx)
+                {
+                    for (int index = 0; index != 100; ++index)
+                    {
+                        ctx.spawn_task_on(jobxx::queue::main_thread, [&ran]()
+                        {
+                            ++ran;
+                            std::this_thread::sleep_for(std::chrono::microseconds(100));
+                        });
+                    }
+                });
+                queue.wait_job_actively(awaited);
+            });
+        });
+
+        bool const result = queue.wait_job_for(outer, std::chrono::seconds(5)) == jobxx::wait_result::complete &&
+            queue.wait_job_for(other, std::chrono::seconds(5)) == jobxx::wait_result::complete;
+
+        queue.close();
+        helper.join();
+        return result;
+    }
+
+    static bool wait_return_test()
+    {
+        worker_pool pool(1);
+        jobxx::queue& queue = pool.queue();
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        // a task waits on awaited, and meanwhile runs the only task of
+        // unrelated; once its wait returns it carries on for a while, but
+        // unrelated must be complete long before then.
+        struct state_t
+        {
+            jobxx::job awaited;
+            jobxx::job unrelated;
+            std::atomic<bool> started = false;
+            std::atomic<bool> checked = false;
+        } state;
+
+        state.awaited = queue.create_job([](jobxx::context& ctx)
+        {
+            ctx.spawn_task_on(jobxx::queue::main_thread, [](){});
+        });
+
+        jobxx::job outer = queue.create_job([&state, &queue, &deadline](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&state, &queue, &deadline]()
+            {
+                state.unrelated = queue.create_job([&state, &deadline](jobxx::context& ctx)
+                {
+                    ctx.spawn_task([&state, &deadline]()
+                    {
+                        // the awaited job completes while this runs, so
+                        // the wait returns straight after it
+                        state.started = true;
+                        while (!state.awaited.complete() && std::chrono::steady_clock::now() < deadline)
+                        {
+                            std::this_thread::yield();
+                        }
+                    });
+                });
+                queue.wait_job_actively(state.awaited);
+
+                while (!state.checked && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+        });
+
+        while (!state.started && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::yield();
+        }
+
+        // completes awaited, by running its task that only we may run
+        queue.work_one();
+
+        bool const complete = queue.wait_job_for(state.unrelated, std::chrono::milliseconds(500)) == jobxx::wait_result::complete;
+        state.checked = true;
+        return complete && queue.wait_job_for(outer, std::chrono::seconds(5)) == jobxx::wait_result::complete;
+    }
+
+    static bool fan_out_test()
+    {
+        worker_pool pool(4);
+
+        // tasks fanning out further tasks of the same job, so that
+        // completions and spawns interleave on every worker
+        std::atomic<int> counter(0);
+        jobxx::job job = pool.queue().create_job([&counter](jobxx::context& ctx)
+        {
+            spawn_n(ctx, 100, [&counter](jobxx::context& ctx)
+            {
+                spawn_n(ctx, 1000, [&counter](){ ++counter; });
+            });
+        });
+        pool.queue().wait_job_actively(job);
+
+        return job.complete() && counter == 100 * 1000;
+    }
+
+    static bool batch_order_test()
+    {
+        jobxx::queue queue;
+
+        // tasks taken a batch at a time still run in order, even when
+        // one of them helps run the next
+        std::vector<int> order;
+        for (int index = 0; index < 100; ++index)
+        {
+            queue.spawn_task([&queue, &order, index]()
+            {
+                order.push_back(index);
+                if (index % 10 == 0)
+                {
+                    queue.work_one();
+                }
+            });
+        }
+        queue.work_all();
+
+        if (order.size() != 100)
+        {
+            return false;
+        }
+        for (int index = 0; index < 100; ++index)
+        {
+            if (order[index] != index)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool batch_steal_test()
+    {
+        worker_pool pool(2);
+        jobxx::queue& queue = pool.queue();
+
+        struct pair_state
+        {
+            std::atomic<bool> flag = false;
+            std::atomic<bool> done = false;
+            std::atomic<bool> stalled = false;
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        } state;
+
+        // a task that blocks on the task after it: the workers are kept
+        // busy enough to take both in one batch, and the blocked worker
+        // must not keep the other task to itself. only one pair is out
+        // at a time, so that both workers are never blocked at once.
+        std::atomic<int> trivial(0);
+        for (int pair = 0; pair != 200 && !state.stalled; ++pair)
+        {
+            state.flag = false;
+            state.done = false;
+            for (int index = 0; index != 100; ++index)
+            {
+                queue.spawn_task([&trivial](){ ++trivial; });
+            }
+            queue.spawn_task([&state]()
+            {
+                while (!state.flag)
+                {
+                    if (std::chrono::steady_clock::now() >= state.deadline)
+                    {
+                        state.stalled = true;
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+                state.done = true;
+            });
+            queue.spawn_task([&state](){ state.flag = true; });
+
+            while (!state.done)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // the last tasks may still be finishing
+        while (trivial != 200 * 100 && std::chrono::steady_clock::now() < state.deadline)
+        {
+            std::this_thread::yield();
+        }
+        return !state.stalled && trivial == 200 * 100;
+    }
+
+    static bool scratch_test()
+    {
+        worker_pool pool(4);
+
+        std::atomic<int> failures(0);
+        jobxx::job job = pool.queue().create_job([&failures](jobxx::context& ctx)
+        {
+            spawn_n(ctx, 1000, [&failures](jobxx::context& ctx)
+            {
+                // small allocations bump through shared chunks, large ones get their own
+                for (std::size_t size : {std::size_t(24), std::size_t(100), std::size_t(64 * 1024)})
+                {
+                    auto* const memory = static_cast<unsigned char*>(ctx.allocate(size, 32));
+                    if (memory == nullptr || reinterpret_cast<std::uintptr_t>(memory) % 32 != 0)
+                    {
+                        ++failures;
+                        continue;
+                    }
+
+                    for (std::size_t index = 0; index != size; ++index)
+                    {
+                        memory[index] = static_cast<unsigned char>(size);
+                    }
+                    for (std::size_t index = 0; index != size; ++index)
+                    {
+                        if (memory[index] != static_cast<unsigned char>(size))
+                        {
+                            ++failures;
+                            break;
+                        }
+                    }
+                }
+            });
+        });
+        pool.queue().wait_job_actively(job);
+
+        // tasks without a job have no arena
+        std::atomic<void*> orphan(&failures);
+        pool.queue().spawn_task([&orphan](jobxx::context& ctx){ orphan = ctx.allocate(16); });
+        pool.queue().work_all();
+        while (orphan != nullptr)
+        {
+            std::this_thread::yield();
+        }
+
+        return failures == 0;
+    }
+
+    static bool combinable_test()
+    {
+        worker_pool pool(4);
+
+        // a thread that helps without a worker id of its own gets an
+        // instance too
+        std::atomic<bool> done(false);
+        std::thread helper([&pool, &done]()
+        {
+            while (!done)
+            {
+                if (!pool.queue().work_one())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        jobxx::combinable<std::vector<int>> seen(pool.queue());
+        jobxx::combinable<int> sum(pool.queue());
+        jobxx::job job = pool.queue().create_job([&seen, &sum](jobxx::context& ctx)
+        {
+            for (int value = 0; value != 1000; ++value)
+            {
+                ctx.spawn_task([&seen, &sum, value](jobxx::context& ctx)
+                {
+                    seen.local(ctx).push_back(value);
+                    sum.local(ctx) += value;
+                });
+            }
+        });
+        pool.queue().wait_job_actively(job);
+        done = true;
+        helper.join();
+
+        std::vector<int> all;
+        seen.for_each([&all](std::vector<int> const& values){ all.insert(all.end(), values.begin(), values.end()); });
+        std::sort(all.begin(), all.end());
+        for (int value = 0; value != 1000; ++value)
+        {
+            if (all.size() != 1000 || all[value] != value)
+            {
+                return false;
+            }
+        }
+
+        if (sum.combine([](int left, int right){ return left + right; }) != 999 * 1000 / 2)
+        {
+            return false;
+        }
+
+        sum.clear();
+        if (sum.combine([](int left, int right){ return left + right; }) != 0)
+        {
+            return false;
+        }
+
+        // a worker of another queue may have the same index as one of
+        // ours, so it must not be given that worker's instance
+        worker_pool other(4);
+        jobxx::job mine = pool.queue().create_job([&sum](jobxx::context& ctx)
+        {
+            spawn_n(ctx, 1000, [&sum](jobxx::context& ctx){ ++sum.local(ctx); });
+        });
+        jobxx::job theirs = other.queue().create_job([&sum](jobxx::context& ctx)
+        {
+            spawn_n(ctx, 1000, [&sum](jobxx::context& ctx){ ++sum.local(ctx); });
+        });
+        pool.queue().wait_job_actively(mine);
+        other.queue().wait_job_actively(theirs);
+        return sum.combine([](int left, int right){ return left + right; }) == 2000;
+    }
+
+    static bool context_test()
+    {
+        worker_pool pool(4);
+
+        // per-worker buffers need nothing but the worker's index
+        std::vector<int> per_worker(jobxx::queue::max_workers);
+        std::atomic<int> failures(0);
+        jobxx::job job = pool.queue().create_job([&per_worker, &failures](jobxx::context& ctx)
+        {
+            spawn_n(ctx, 1000, [&per_worker, &failures](jobxx::context& ctx)
+            {
+                int const index = ctx.worker_index();
+                if (index < 0 || index >= ctx.worker_count())
+                {
+                    ++failures;
+                    return;
+                }
+                ++per_worker[index];
+
+                int data = 0;
+                ctx.set_user_data(&data);
+                if (ctx.user_data() != &data || ctx.current_job().complete())
+                {
+                    ++failures;
+                }
+            });
+        });
+        pool.queue().wait_job_actively(job);
+
+        int total = 0;
+        for (int count : per_worker)
+        {
+            total += count;
+        }
+
+        // the halves of a join may run at once, so a stolen half must
+        // not share the other's data, though it shares the job
+        struct halves
+        {
+            static void split(jobxx::context& ctx, int depth, std::atomic<int>& failures)
+            {
+                if (depth == 0)
+                {
+                    int data = 0;
+                    ctx.set_user_data(&data);
+                    for (int spin = 0; spin != 1000 && ctx.user_data() == &data; ++spin)
+                    {
+                        std::this_thread::yield();
+                    }
+                    if (ctx.user_data() != &data || ctx.current_job().complete())
+                    {
+                        ++failures;
+                    }
+                    ctx.set_user_data(nullptr);
+                    return;
+                }
+                jobxx::join(ctx,
+                    [depth, &failures](jobxx::context& ctx){ split(ctx, depth - 1, failures); },
+                    [depth, &failures](jobxx::context& ctx){ split(ctx, depth - 1, failures); });
+            }
+        };
+        jobxx::job joined = pool.queue().create_job([&failures](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&failures](jobxx::context& ctx){ halves::split(ctx, 6, failures); });
+        });
+        pool.queue().wait_job_actively(joined);
+
+        // tasks without a job have an empty one, and start without data
+        std::atomic<int> orphans(0);
+        pool.queue().spawn_task([&orphans](jobxx::context& ctx)
+        {
+            if (ctx.current_job().complete() && ctx.user_data() == nullptr)
+            {
+                ++orphans;
+            }
+        });
+        pool.queue().work_all();
+        while (orphans == 0)
+        {
+            std::this_thread::yield();
+        }
+
+        return failures == 0 && total == 1000;
+    }
+
+    static bool pipeline_test()
+    {
+        worker_pool pool(4);
+
+        constexpr int count = 1000;
+        constexpr int tokens = 8;
+
+        std::vector<int> values(count);
+        int produced = 0;
+        std::atomic<int> completed(0);
+        int most_in_flight = 0;
+        std::vector<int> output;
+
+        jobxx::pipeline stream;
+        stream.add_stage(jobxx::stage_mode::serial_in_order, [&](void*) -> void*
+        {
+            if (produced == count)
+            {
+                return nullptr;
+            }
+            most_in_flight = std::max(most_in_flight, produced - completed + 1);
+            values[produced] = produced;
+            return &values[produced++];
+        });
+        stream.add_stage(jobxx::stage_mode::parallel, [](void* item) -> void*
+        {
+            int& value = *static_cast<int*>(item);
+            value *= value;
+            return item;
+        });
+        stream.add_stage(jobxx::stage_mode::serial_out_of_order, [](void* item){ return item; });
+        stream.add_stage(jobxx::stage_mode::serial_in_order, [&](void* item) -> void*
+        {
+            output.push_back(*static_cast<int*>(item));
+            ++completed;
+            return item;
+        });
+        stream.run(pool.queue(), tokens);
+
+        if (most_in_flight > tokens || output.size() != count)
+        {
+            return false;
+        }
+        for (int index = 0; index != count; ++index)
+        {
+            if (output[index] != index * index)
+            {
+                return false;
+            }
+        }
+
+        // items dropped by one stage skip the rest without stalling the in-order stages
+        produced = 0;
+        output.clear();
+        jobxx::pipeline evens;
+        evens.add_stage(jobxx::stage_mode::serial_in_order, [&](void*) -> void*
+        {
+            return produced == count ? nullptr : &values[produced++];
+        });
+        evens.add_stage(jobxx::stage_mode::parallel, [](void* item) -> void*
+        {
+            return *static_cast<int*>(item) % 2 == 0 ? item : nullptr;
+        });
+        evens.add_stage(jobxx::stage_mode::serial_in_order, [&](void* item) -> void*
+        {
+            output.push_back(*static_cast<int*>(item));
+            return item;
+        });
+        evens.run(pool.queue(), tokens);
+
+        if (output.size() != count / 2)
+        {
+            return false;
+        }
+        for (int index = 0; index != count / 2; ++index)
+        {
+            if (output[index] != (index * 2) * (index * 2))
+            {
+                return false;
+            }
+        }
+
+        // on a queue with no room to spare, a spawn the queue refuses must
+        // not lose its item or its token; first with the queue already
+        // full as the pipeline starts, then with workers racing for room
+        jobxx::queue_capacity capacity;
+        capacity.max_tasks = 1;
+        jobxx::queue small(capacity);
+        int filler = 0;
+        small.spawn_task([&filler](){ ++filler; });
+
+        produced = 0;
+        output.clear();
+        evens.run(small, tokens);
+        if (filler != 1 || output.size() != count / 2)
+        {
+            return false;
+        }
+
+        std::vector<std::thread> small_workers;
+        for (int index = 0; index != 3; ++index)
+        {
+            small_workers.emplace_back([&small](){ small.work_forever(); });
+        }
+
+        produced = 0;
+        output.clear();
+        evens.run(small, tokens);
+
+        small.close();
+        for (auto& worker : small_workers)
+        {
+            worker.join();
+        }
+
+        if (output.size() != count / 2)
+        {
+            return false;
+        }
+        for (int index = 0; index != count / 2; ++index)
+        {
+            if (output[index] != (index * 2) * (index * 2))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool channel_test()
+    {
+        // a receiver that helps its queue runs the task that sends to it
+        {
+            jobxx::queue queue;
+            jobxx::channel<int> channel;
+            queue.spawn_task([&channel](){ channel.send(42); });
+
+            int value = 0;
+            if (channel.recv(queue, value) != jobxx::channel_result::success || value != 42)
+            {
+                return false;
+            }
+        }
+
+        worker_pool pool(2);
+        jobxx::channel<int> channel(4);
+
+        // a full channel refuses a try_send without taking the value
+        std::string kept("kept");
+        jobxx::channel<std::string> tiny(1);
+        if (tiny.try_send(std::string("first")) != jobxx::channel_result::success ||
+            tiny.try_send(std::move(kept)) != jobxx::channel_result::full || kept != "kept")
+        {
+            return false;
+        }
+
+        // producers wait on the full channel while the main thread consumes
+        constexpr int producers = 4;
+        constexpr int per_producer = 250;
+        jobxx::queue& queue = pool.queue();
+        jobxx::job job = queue.create_job([&queue, &channel](jobxx::context& ctx)
+        {
+            for (int producer = 0; producer < producers; ++producer)
+            {
+                ctx.spawn_task([&queue, &channel, producer]()
+                {
+                    for (int index = 0; index < per_producer; ++index)
+                    {
+                        channel.send(queue, producer * per_producer + index + 1);
+                    }
+                });
+            }
+        });
+
+        long sum = 0;
+        for (int index = 0; index < producers * per_producer; ++index)
+        {
+            int value = 0;
+            if (channel.recv(value) != jobxx::channel_result::success)
+            {
+                return false;
+            }
+            sum += value;
+        }
+        queue.wait_job_actively(job);
+
+        int const count = producers * per_producer;
+        if (sum != static_cast<long>(count) * (count + 1) / 2)
+        {
+            return false;
+        }
+
+        // once closed, the remaining values drain before recv fails
+        int value = 0;
+        channel.send(7);
+        channel.close();
+        return channel.try_send(8) == jobxx::channel_result::closed &&
+            channel.recv(value) == jobxx::channel_result::success && value == 7 &&
+            channel.recv(value) == jobxx::channel_result::closed;
+    }
+
+    static bool task_mutex_test()
+    {
+        // a lock that waits by helping runs the task that releases it
+        {
+            jobxx::queue queue;
+            jobxx::task_mutex mutex;
+            mutex.lock();
+            if (mutex.try_lock())
+            {
+                return false;
+            }
+            queue.spawn_task([&mutex](){ mutex.unlock(); });
+            mutex.lock(queue);
+            mutex.unlock();
+        }
+
+        worker_pool pool(3);
+        jobxx::queue& queue = pool.queue();
+        jobxx::task_mutex mutex;
+        int counter = 0;
+
+        jobxx::job job = queue.create_job([&queue, &mutex, &counter](jobxx::context& ctx)
+        {
+            for (int index = 0; index < 500; ++index)
+            {
+                ctx.spawn_task([&queue, &mutex, &counter]()
+                {
+                    mutex.lock(queue);
+                    ++counter;
+                    mutex.unlock();
+                });
+                ctx.spawn_task([&mutex, &counter]()
+                {
+                    std::lock_guard<jobxx::task_mutex> _(mutex);
+                    ++counter;
+                });
+            }
+        });
+        queue.wait_job_actively(job);
+
+        std::lock_guard<jobxx::task_mutex> _(mutex);
+        return counter == 1000;
+    }
+
+    template <typename QueueT>
+    static bool run_basic_queue(QueueT& queue, int threads, int tasks)
+    {
+        std::vector<std::thread> workers;
+        for (int index = 0; index < threads; ++index)
+        {
+            workers.emplace_back([&queue](){ queue.work_forever(); });
+        }
+
+        std::atomic<int> counter(0);
+        for (int index = 0; index < tasks; ++index)
+        {
+            // a bounded queue may refuse the task until the workers catch up
+            while (queue.spawn_task([&counter](){ ++counter; }) == jobxx::spawn_result::queue_full)
+            {
+                queue.work_one();
+            }
+        }
+
+        while (counter != tasks)
+        {
+            queue.work_one();
+        }
+
+        queue.close();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        return queue.spawn_task([](){}) == jobxx::spawn_result::queue_closed;
+    }
+
+    static bool basic_queue_test()
+    {
+        jobxx::basic_queue<> standard;
+        if (!run_basic_queue(standard, 2, 1000))
+        {
+            return false;
+        }
+
+        jobxx::basic_queue<jobxx::spmc_ring_queue_policy<4>, jobxx::pooled_alloc_policy, jobxx::no_wake_policy> ring;
+        if (ring.spawn_task([](){}) != jobxx::spawn_result::success ||
+            ring.spawn_task([](){}) != jobxx::spawn_result::success ||
+            ring.spawn_task([](){}) != jobxx::spawn_result::success ||
+            ring.spawn_task([](){}) != jobxx::spawn_result::success ||
+            ring.spawn_task([](){}) != jobxx::spawn_result::queue_full)
+        {
+            return false;
+        }
+        ring.work_all();
+
+        // tasks still queued are run when the queue is destroyed
+        int left = 0;
+        {
+            jobxx::basic_queue<> doomed;
+            int* const counter = &left;
+            doomed.spawn_task([counter](){ ++*counter; });
+            doomed.spawn_task([counter](){ ++*counter; });
+        }
+        if (left != 2)
+        {
+            return false;
+        }
+
+        return run_basic_queue(ring, 2, 1000);
+    }
+
+    static bool elastic_pool_test()
+    {
+        constexpr int parallelism = 2;
+        constexpr int blockers = 4;
+
+        jobxx::queue queue;
+        jobxx::elastic_pool pool(queue, parallelism, std::chrono::milliseconds(10));
+
+        // every blocking task waits until all of them are blocked at once,
+        // which is only possible if the pool stands in for them.
+        std::atomic<int> blocked(0);
+        std::atomic<bool> release(false);
+        for (int index = 0; index < blockers; ++index)
+        {
+            pool.spawn_blocking([&blocked, &release]()
+            {
+                ++blocked;
+                while (!release)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+        }
+
+        // the main thread doesn't help, so only the pool can make progress
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (blocked != blockers && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (blocked != blockers)
+        {
+            release = true;
+            return false;
+        }
+
+        // ordinary work still runs with full parallelism
+        std::atomic<int> ran(0);
+        for (int index = 0; index < 8; ++index)
+        {
+            queue.spawn_task([&ran](){ ++ran; });
+        }
+        while (ran != 8 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        release = true;
+        if (ran != 8 || pool.workers() < parallelism + blockers)
+        {
+            return false;
+        }
+
+        // once nothing blocks, the spares retire after their idle timeout
+        while (pool.workers() != parallelism && std::chrono::steady_clock::now() < deadline + std::chrono::seconds(5))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return pool.workers() == parallelism;
+    }
+
+    static bool worker_reuse_test()
+    {
+        struct
+        {
+            std::atomic<int> probed{0};
+            std::atomic<int> targeted{0};
+            std::atomic<int> finished{0};
+            std::atomic<int> index{-1};
+        } state;
+
+        jobxx::queue queue;
+        jobxx::elastic_pool pool(queue, 1, std::chrono::milliseconds(1));
+
+        // each round starts a spare and lets it retire, more times over
+        // than there are worker ids, and the last spare must still get
+        // one, along with a mailbox, from those the others gave back.
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+        for (int round = 0; round != jobxx::queue::max_workers + 16; ++round)
+        {
+            pool.spawn_blocking([&state, &deadline, round]()
+            {
+                while (state.probed == round && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                ++state.finished;
+            });
+            queue.spawn_task([&state](jobxx::context& ctx)
+            {
+                state.index = ctx.worker_index();
+                if (ctx.spawn_task_on(ctx.worker_index(), [&state](){ ++state.targeted; }) != jobxx::spawn_result::success)
+                {
+                    state.index = -1;
+                    ++state.targeted;
+                }
+                ++state.probed;
+            });
+
+            auto const done = [&state, &pool, round]
+            {
+                return state.targeted != round && state.finished != round && pool.workers() == 1;
+            };
+            while (!done() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (!done() || state.index < 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool urgent_lane_test()
+    {
+        jobxx::queue queue;
+        std::thread bulk_worker([&queue](){ queue.work_forever(); });
+
+        std::atomic<bool> urgent_ran(false);
+        std::atomic<bool> bulk_ran(false);
+        std::atomic<bool> release(false);
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        bool result = true;
+        {
+            jobxx::urgent_lane lane(queue);
+
+            // the only bulk worker is held up until the urgent task runs,
+            // so the lane must be the one to run it
+            queue.spawn_task([&urgent_ran, deadline]()
+            {
+                while (!urgent_ran && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            queue.spawn_urgent_task([&urgent_ran](){ urgent_ran = true; });
+
+            while (!urgent_ran && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            result = result && urgent_ran;
+        }
+        {
+            // with no bulk worker free, a lane worker with a slice to
+            // spare runs bulk tasks once the lane is empty
+            jobxx::urgent_lane_options options;
+            options.bulk_slice = std::chrono::milliseconds(10);
+
+            queue.spawn_task([&release, deadline]()
+            {
+                while (!release && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            jobxx::urgent_lane lane(queue, options);
+            queue.spawn_task([&bulk_ran](){ bulk_ran = true; });
+            queue.spawn_urgent_task([](){});
+
+            while (!bulk_ran && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            release = true;
+            result = result && bulk_ran;
+        }
+#if defined(__linux__)
+        {
+            // a worker pins itself before it runs anything, and the lane
+            // knows whether it managed to by the time it is constructed
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            int cpu = 0;
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+            {
+                while (cpu != 63 && !CPU_ISSET(cpu, &allowed))
+                {
+                    ++cpu;
+                }
+            }
+
+            jobxx::urgent_lane_options options;
+            options.cpu_mask = std::uint64_t(1) << cpu;
+            jobxx::urgent_lane lane(queue, options);
+
+            // keep the bulk worker out of the way, as in the first case
+            std::atomic<int> ran_on(-1);
+            queue.spawn_task([&ran_on, deadline]()
+            {
+                while (ran_on == -1 && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue.spawn_urgent_task([&ran_on](){ ran_on = sched_getcpu(); });
+            while (ran_on == -1 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            result = result && lane.isolated() && ran_on == cpu;
+        }
+#endif
+
+        queue.close();
+        bulk_worker.join();
+        return result;
+    }
+
+    static bool algorithm_test()
+    {
+        worker_pool pool(2);
+        jobxx::queue& queue = pool.queue();
+
+        // big enough for several merge passes, plus a small serial case
+        for (std::size_t const size : {std::size_t(1000), std::size_t(300000)})
+        {
+            std::mt19937 random(static_cast<std::mt19937::result_type>(size));
+            std::vector<int> input(size);
+            for (int& value : input)
+            {
+                value = static_cast<int>(random() % 1000);
+            }
+
+            std::vector<int> sorted = input;
+            std::vector<int> expected_sorted = input;
+            jobxx::parallel_sort(queue, sorted.begin(), sorted.end());
+            std::sort(expected_sorted.begin(), expected_sorted.end());
+
+            std::vector<long> squares(size);
+            std::vector<long> expected_squares(size);
+            jobxx::parallel_transform(queue, input.begin(), input.end(), squares.begin(), [](int value){ return long(value) * value; });
+            std::transform(input.begin(), input.end(), expected_squares.begin(), [](int value){ return long(value) * value; });
+
+            auto const even = [](int value){ return value % 2 == 0; };
+            std::vector<int> evens(size);
+            std::vector<int> expected_evens;
+            evens.erase(jobxx::parallel_copy_if(queue, input.begin(), input.end(), evens.begin(), even), evens.end());
+            std::copy_if(input.begin(), input.end(), std::back_inserter(expected_evens), even);
+
+            std::vector<int> partitioned = input;
+            std::vector<int> expected_partitioned = input;
+            auto const split = jobxx::parallel_partition(queue, partitioned.begin(), partitioned.end(), even) - partitioned.begin();
+            auto const expected_split = std::stable_partition(expected_partitioned.begin(), expected_partitioned.end(), even) - expected_partitioned.begin();
+
+            std::vector<int> unique = sorted;
+            std::vector<int> expected_unique = expected_sorted;
+            unique.erase(jobxx::parallel_unique(queue, unique.begin(), unique.end()), unique.end());
+            expected_unique.erase(std::unique(expected_unique.begin(), expected_unique.end()), expected_unique.end());
+
+            if (sorted != expected_sorted || squares != expected_squares || evens != expected_evens ||
+                split != expected_split || partitioned != expected_partitioned || unique != expected_unique)
+            {
+                return false;
+            }
+        }
+
+        // values that own memory must be moved, never copied or lost
+        std::vector<std::string> words;
+        for (int index = 0; index < 20000; ++index)
+        {
+            words.push_back(std::to_string((index * 7919) % 20000));
+        }
+        std::vector<std::string> expected_words = words;
+        jobxx::parallel_sort(queue, words.begin(), words.end());
+        std::sort(expected_words.begin(), expected_words.end());
+        return words == expected_words;
+    }
+
+    static bool sender_test()
+    {
+        worker_pool pool(2);
+        jobxx::queue& queue = pool.queue();
+        jobxx::scheduler const scheduler = queue.get_scheduler();
+
+        // then continues on whichever thread ran the scheduled task
+        auto const value = jobxx::sync_wait(queue, jobxx::then(scheduler.schedule(), [](){ return 7; }));
+        if (!value || std::get<0>(*value) != 7 || !(scheduler == queue.get_scheduler()))
+        {
+            return false;
+        }
+
+        // when_all gathers every value in order
+        auto const sum = jobxx::sync_wait(queue, jobxx::then(
+            jobxx::when_all(
+                jobxx::then(scheduler.schedule(), [](){ return 20; }),
+                scheduler.schedule(),
+                jobxx::then(scheduler.schedule(), [](){ return std::string("22"); })),
+            [](int first, std::string const& second){ return first + std::stoi(second); }));
+        if (!sum || std::get<0>(*sum) != 42)
+        {
+            return false;
+        }
+
+        // with nothing to wait for, when_all is done as soon as it starts
+        if (!jobxx::sync_wait(queue, jobxx::when_all()))
+        {
+            return false;
+        }
+
+        // a job completes its sender once its last task retires, or at once if it already has
+        std::atomic<int> count = 0;
+        jobxx::job job = queue.create_job([&count](jobxx::context& ctx)
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                ctx.spawn_task([&count](){ ++count; });
+            }
+        });
+        auto const after = jobxx::sync_wait(queue, jobxx::then(jobxx::as_sender(job), [&count](){ return count.load(); }));
+        auto const again = jobxx::sync_wait(queue, jobxx::as_sender(job));
+        if (!after || std::get<0>(*after) != 100 || !again)
+        {
+            return false;
+        }
+
+        // a closed queue fails the schedule, and with it the whole
+        jobxx::queue closed;
+        closed.close();
+        return !jobxx::sync_wait(closed, jobxx::when_all(jobxx::as_sender(job), closed.get_scheduler().schedule()));
+    }
+
+    static bool join_test()
+    {
+        worker_pool pool(3);
+        jobxx::queue& queue = pool.queue();
+
+        // a recursive sum, split down to single elements
+        std::vector<long> values(20000);
+        for (std::size_t index = 0; index != values.size(); ++index)
+        {
+            values[index] = static_cast<long>(index);
+        }
+
+        struct summer
+        {
+            long const* first;
+            long const* last;
+            long& result;
+
+            void operator()(jobxx::context& ctx) const
+            {
+                if (last - first == 1)
+                {
+                    result = *first;
+                    return;
+                }
+                long const* const middle = first + (last - first) / 2;
+                long left = 0;
+                long right = 0;
+                jobxx::join(ctx, summer{first, middle, left}, summer{middle, last, right});
+                result = left + right;
+            }
+        };
+
+        long sum = 0;
+        jobxx::job job = queue.create_job([&](jobxx::context& ctx)
+        {
+            ctx.spawn_task([&](jobxx::context& task_ctx){ summer{values.data(), values.data() + values.size(), sum}(task_ctx); });
+        });
+        queue.wait_job_actively(job);
+
+        // outside of a worker, both halves simply run in turn
+        int order = 0;
+        int first_ran = 0;
+        int second_ran = 0;
+        jobxx::job inline_job = queue.create_job([&](jobxx::context& ctx)
+        {
+            jobxx::join(ctx, [&](){ first_ran = ++order; }, [&](){ second_ran = ++order; });
+        });
+
+        return sum == 20000L * 19999 / 2 && first_ran == 1 && second_ran == 2;
+    }
+
+#if defined(__linux__)
+    static bool reactor_test()
+    {
+        worker_pool pool(2);
+        jobxx::reactor reactor(pool.queue());
+
+        // a pipe isn't readable until written, so the read must wait in the reactor
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            return false;
+        }
+
+        char received[6] = {};
+        jobxx::io_request read_request;
+        read_request.fd = fds[0];
+        read_request.buffer = received;
+        read_request.size = sizeof(received);
+
+        std::atomic<bool> read_done(false);
+        jobxx::job job = pool.queue().create_job([&reactor, &read_request, &read_done](jobxx::context& ctx)
+        {
+            reactor.read(ctx, read_request, [&read_done](){ read_done = true; });
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (read_done || job.complete())
+        {
+            return false;
+        }
+
+        char const sent[] = "jobxx";
+        jobxx::io_request write_request;
+        write_request.fd = fds[1];
+        write_request.buffer = const_cast<char*>(sent);
+        write_request.size = sizeof(sent);
+        std::atomic<bool> write_done(false);
+        reactor.write(write_request, [&write_done](){ write_done = true; });
+
+        // don't wait actively; the workers must notice the completion on their own
+        while (!job.complete() || !write_done)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        close(fds[0]);
+        close(fds[1]);
+
+        if (!read_done || read_request.result != sizeof(sent) || std::string(received) != sent)
+        {
+            return false;
+        }
+
+        // regular files are always ready, and complete at once
+        FILE* const file = tmpfile();
+        fputs("file", file);
+        fflush(file);
+        rewind(file);
+
+        char contents[8] = {};
+        jobxx::io_request file_request;
+        file_request.fd = fileno(file);
+        file_request.buffer = contents;
+        file_request.size = sizeof(contents);
+        std::atomic<bool> file_done(false);
+        reactor.read(file_request, [&file_done](){ file_done = true; });
+        while (!file_done)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        fclose(file);
+        if (file_request.result != 4 || std::string(contents) != "file")
+        {
+            return false;
+        }
+
+        // destroying a reactor cancels what is still pending, and the
+        // continuation gets to see it
+        if (pipe(fds) != 0)
+        {
+            return false;
+        }
+        char ignored = 0;
+        jobxx::io_request cancelled_request;
+        cancelled_request.fd = fds[0];
+        cancelled_request.buffer = &ignored;
+        cancelled_request.size = sizeof(ignored);
+        bool cancelled = false;
+        {
+            worker_pool other(1);
+            jobxx::reactor doomed(other.queue());
+            if (!doomed.valid())
+            {
+                return false;
+            }
+            doomed.read(cancelled_request, [&cancelled, &cancelled_request](){ cancelled = cancelled_request.result == -ECANCELED; });
+        }
+        close(fds[0]);
+        close(fds[1]);
+
+        return cancelled;
+    }
+
+    // lives in memory shared with the forked workers
+    struct shared_totals
+    {
+        std::atomic<int> count;
+        std::atomic<long> sum;
+    };
+    static shared_totals* totals = nullptr;
+
+    static void add_to_totals(void const* payload, std::size_t size)
+    {
+        int value = 0;
+        if (size == sizeof(value))
+        {
+            memcpy(&value, payload, sizeof(value));
+            totals->sum += value;
+            ++totals->count;
+        }
+    }
+
+    static bool shared_queue_test()
+    {
+        void* const memory = mmap(nullptr, sizeof(shared_totals), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return false;
+        }
+        totals = new (memory) shared_totals{};
+
+        jobxx::shared_queue queue;
+        if (!queue.create(16) || !queue.register_function(0, &add_to_totals))
+        {
+            return false;
+        }
+
+        // the workers are other processes, each draining the same ring
+        constexpr int workers = 2;
+        pid_t children[workers] = {};
+        for (int index = 0; index < workers; ++index)
+        {
+            children[index] = fork();
+            if (children[index] == 0)
+            {
+                queue.work_forever();
+                _exit(0);
+            }
+        }
+
+        constexpr int tasks = 500;
+        for (int value = 1; value <= tasks; ++value)
+        {
+            // the ring is smaller than the number of tasks, so it fills up
+            while (queue.spawn_task(0, &value, sizeof(value)) == jobxx::spawn_result::queue_full)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        char oversized[jobxx::shared_queue::max_payload + 1] = {};
+        bool const refused = queue.spawn_task(0, oversized, sizeof(oversized)) == jobxx::spawn_result::invalid_payload;
+
+        while (totals->count != tasks)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        queue.close();
+
+        bool exited = true;
+        for (pid_t child : children)
+        {
+            int status = 0;
+            exited = waitpid(child, &status, 0) == child && WIFEXITED(status) && exited;
+        }
+
+        bool const summed = totals->sum == static_cast<long>(tasks) * (tasks + 1) / 2;
+        munmap(memory, sizeof(shared_totals));
+        totals = nullptr;
+
+        return refused && exited && summed && queue.spawn_task(0, nullptr, 0) == jobxx::spawn_result::queue_closed;
+    }
+
+    static bool shared_queue_open_test()
+    {
+        jobxx::shared_queue queue;
+        if (!queue.create(4))
+        {
+            return false;
+        }
+
+        // a second mapping of the same file sees the same ring
+        jobxx::shared_queue other;
+        if (!other.open(dup(queue.fd())))
+        {
+            return false;
+        }
+
+        // nobody registered function 1, which other has to own up to
+        bool const spawned = queue.spawn_task(1, nullptr, 0) == jobxx::spawn_result::success;
+        bool const reported = other.work_one() && other.unhandled() == 1 && !other.work_one();
+
+        // a file cut short of its ring is refused, as is one that's empty
+        int const truncated = dup(queue.fd());
+        bool const short_refused = ftruncate(truncated, 64) == 0 && !jobxx::shared_queue{}.open(truncated);
+        ::close(truncated);
+
+        int const empty = memfd_create("jobxx_test", MFD_CLOEXEC);
+        bool const empty_refused = empty != -1 && !jobxx::shared_queue{}.open(empty);
+        ::close(empty);
+
+        return spawned && reported && short_refused && empty_refused;
+    }
+#endif
+
 }
 
 int main()
@@ -198,6 +2136,40 @@ int main()
         execute(&basic_test, 10) &&
         execute(&thread_test) &&
         execute(&inactive_wait_thread_test) &&
-        execute(&multi_queue_job_test)
+        execute(&multi_queue_job_test) &&
+        execute(&timeout_test) &&
+        execute(&park_stress_test, 3) &&
+        execute(&wait_set_test) &&
+        execute(&cancel_test) &&
+        execute(&capacity_test) &&
+        execute(&lifo_slot_test) &&
+        execute(&lifo_block_test, 10) &&
+        execute(&inline_spawn_test) &&
+        execute(&targeted_task_test) &&
+        execute(&fan_out_test, 10) &&
+        execute(&nested_wait_test, 10) &&
+        execute(&wait_return_test, 5) &&
+        execute(&batch_order_test) &&
+        execute(&batch_steal_test, 5) &&
+        execute(&scratch_test) &&
+        execute(&combinable_test, 10) &&
+        execute(&context_test, 10) &&
+        execute(&job_stats_test) &&
+        execute(&pipeline_test, 10) &&
+        execute(&channel_test, 10) &&
+        execute(&task_mutex_test, 10) &&
+        execute(&basic_queue_test, 10) &&
+        execute(&elastic_pool_test) &&
+        execute(&worker_reuse_test) &&
+        execute(&urgent_lane_test) &&
+        execute(&algorithm_test) &&
+        execute(&sender_test, 10) &&
+        execute(&join_test, 10) &&
+#if defined(__linux__)
+        execute(&reactor_test) &&
+        execute(&shared_queue_test) &&
+        execute(&shared_queue_open_test) &&
+#endif
+        true
     );
 }
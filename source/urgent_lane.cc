@@ -0,0 +1,112 @@
+// jobxx - C++ lightweight task library.
+//
+// This is free and unencumbered software released into the public domain.
+// 
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non - commercial, and by any
+// means.
+// 
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// 
+// For more information, please refer to <http://unlicense.org/>
+//
+// Authors:
+//   Sean Middleditch <sean.middleditch@gmail.com>
+
+#include "jobxx/urgent_lane.h"
+#include "jobxx/queue.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // true if the calling thread now has what was asked of it, which
+    // is trivially so when nothing was.
+    bool isolate(jobxx::urgent_lane_options const& options)
+    {
+        bool isolated = true;
+
+#if defined(__linux__)
+        if (options.realtime_priority != 0)
+        {
+            sched_param param = {};
+            param.sched_priority = options.realtime_priority;
+            isolated = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 && isolated;
+        }
+
+        if (options.cpu_mask != 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (int cpu = 0; cpu != 64; ++cpu)
+            {
+                if ((options.cpu_mask >> cpu) & 1)
+                {
+                    CPU_SET(cpu, &cpus);
+                }
+            }
+            isolated = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 && isolated;
+        }
+#else
+        // no portable way to ask for either
+        isolated = options.realtime_priority == 0 && options.cpu_mask == 0;
+#endif
+
+        return isolated;
+    }
+}
+
+jobxx::urgent_lane::urgent_lane(queue& queue, urgent_lane_options const& options) :
+    _queue(queue),
+    _bulk_slice(options.bulk_slice)
+{
+    int const count = options.workers > 0 ? options.workers : 1;
+    for (int index = 0; index < count; ++index)
+    {
+        _workers.emplace_back([this, &options]()
+        {
+            // before the first task, so that none runs unisolated
+            if (!isolate(options))
+            {
+                _isolated.store(false, std::memory_order_release);
+            }
+            _reported.fetch_add(1, std::memory_order_acq_rel);
+            _started.unpark_all();
+
+            auto stop = [this]{ return _stopping.load(std::memory_order_acquire); };
+            _queue._work_urgent(_bulk_slice, stop);
+        });
+    }
+
+    // options is only borrowed until every worker has looked at it
+    _started.park_until([this, count]{ return _reported.load(std::memory_order_acquire) == count; });
+}
+
+jobxx::urgent_lane::~urgent_lane()
+{
+    _stopping.store(true, std::memory_order_release);
+    _queue._wake_urgent();
+
+    for (auto& thread : _workers)
+    {
+        thread.join();
+    }
+}